@@ -0,0 +1,157 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/camera.h>
+#include <learnopengl/gpu_profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Drives --benchmark: the camera follows a closed path through the storage room that is sampled by frame number
+// rather than by time, so every run renders exactly the same frames whatever the speed of the machine. The first
+// frames are rendered but not measured, to keep shader compilation and first-use costs out of the numbers.
+class Benchmark
+{
+public:
+    Benchmark(unsigned int frames, unsigned int warmupFrames = 30) : frames(frames), warmupFrames(warmupFrames)
+    {
+    }
+
+    bool finished() const
+    {
+        return frame >= warmupFrames + frames;
+    }
+
+    // places the camera for this frame and starts its CPU timer
+    void beginFrame(Camera &camera)
+    {
+        Clock::time_point now = Clock::now();
+        if (measuring() && frame > warmupFrames)
+            frameTimes.push_back(milliseconds(frameStart, now));
+        if (frame == warmupFrames)
+        {
+            GpuProfiler::instance().reset();
+            measureStart = now;
+        }
+        frameStart = now;
+
+        float position = (float)(frame % frames) / frames * keyframeCount();
+        unsigned int segment = (unsigned int)position;
+        float t = position - segment;
+        camera.Position = catmullRom(segment, t, &Keyframe::position);
+        camera.LookAt(catmullRom(segment, t, &Keyframe::target));
+    }
+
+    // CPU time is the time spent recording the frame, up to but excluding the buffer swap. GPU time is the whole
+    // frame's, collected by the GpuProfiler this frame for the frame FRAMES_IN_FLIGHT earlier: measured frames from
+    // then on are recorded, and the results of the last few never come in
+    void endFrame()
+    {
+        if (measuring())
+            cpuTimes.push_back(milliseconds(frameStart, Clock::now()));
+        double gpuTime = GpuProfiler::instance().completedFrameMilliseconds();
+        if (measuring() && frame >= warmupFrames + GpuProfiler::FRAMES_IN_FLIGHT && gpuTime >= 0.0)
+            gpuTimes.push_back(gpuTime);
+        frame++;
+        if (finished())
+            measureEnd = Clock::now();
+    }
+
+    void report(unsigned int width, unsigned int height) const
+    {
+        double seconds = std::chrono::duration<double>(measureEnd - measureStart).count();
+
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Benchmark: " << frames << " frames at " << width << "x" << height << " (" << warmupFrames
+                  << " warm-up frames not measured)" << std::endl;
+        printPercentiles("frame time", frameTimes);
+        printPercentiles("cpu time", cpuTimes);
+        printPercentiles("gpu time", gpuTimes);
+        std::cout << "  throughput       " << frames / seconds << " frames/s, "
+                  << frames / seconds * width * height / 1.0e6 << " Mpixels/s" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+        GpuProfiler::instance().report();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Keyframe
+    {
+        glm::vec3 position;
+        glm::vec3 target;
+    };
+
+    unsigned int frames;
+    unsigned int warmupFrames;
+    unsigned int frame = 0;
+    Clock::time_point frameStart, measureStart, measureEnd;
+    std::vector<double> frameTimes;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+
+    bool measuring() const
+    {
+        return frame >= warmupFrames && !finished();
+    }
+
+    // entrance, past the crates, along the parallax walls, close up to the barrel and looking down on the manhole
+    static const Keyframe *keyframes()
+    {
+        static const Keyframe path[] = {
+            {glm::vec3(0.0f, 1.4f, 4.5f), glm::vec3(0.0f, 1.0f, -3.0f)},
+            {glm::vec3(3.8f, 1.6f, 3.0f), glm::vec3(-2.0f, 0.5f, -1.5f)},
+            {glm::vec3(3.8f, 2.5f, -3.8f), glm::vec3(-4.0f, 1.5f, 3.0f)},
+            {glm::vec3(0.0f, 1.2f, -1.0f), glm::vec3(0.0f, 0.85f, -3.0f)},
+            {glm::vec3(-3.8f, 1.0f, -3.5f), glm::vec3(4.0f, 2.0f, 4.0f)},
+            {glm::vec3(-3.5f, 3.5f, 3.8f), glm::vec3(-4.0f, -0.5f, 3.8f)},
+        };
+        return path;
+    }
+
+    static unsigned int keyframeCount()
+    {
+        return 6;
+    }
+
+    // Catmull-Rom spline through the keyframes, closed into a loop
+    static glm::vec3 catmullRom(unsigned int segment, float t, glm::vec3 Keyframe::*member)
+    {
+        unsigned int count = keyframeCount();
+        glm::vec3 p0 = keyframes()[(segment + count - 1) % count].*member;
+        glm::vec3 p1 = keyframes()[segment % count].*member;
+        glm::vec3 p2 = keyframes()[(segment + 1) % count].*member;
+        glm::vec3 p3 = keyframes()[(segment + 2) % count].*member;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                       (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    static double milliseconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    static void printPercentiles(const char *name, std::vector<double> samples)
+    {
+        if (samples.empty())
+            return;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        auto percentile = [&samples](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+        std::cout << "  " << std::left << std::setw(16) << name << std::right << " min " << samples.front() << " ms  avg "
+                  << sum / samples.size() << " ms  p50 " << percentile(0.5) << " ms  p90 "
+                  << percentile(0.9) << " ms  p99 " << percentile(0.99) << " ms  max " << samples.back() << " ms" << std::endl;
+    }
+};
+
+#endif
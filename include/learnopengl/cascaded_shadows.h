@@ -0,0 +1,245 @@
+#ifndef CASCADED_SHADOWS_H
+#define CASCADED_SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/light_uniform_buffer.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Cascaded shadow maps for the directional light, with the static part of every cascade cached.
+//
+// Each cascade covers a depth range of the camera frustum with a bounding sphere, so its size doesn't change as
+// the camera turns. The sphere's center is snapped in light space to a grid of SNAP_TEXELS texels and the
+// cascade is made one grid step larger than the sphere, so it keeps covering its slice of the frustum while the
+// camera moves within a grid cell. Until the camera leaves the cell (or the light, the field of view or the
+// scene bounds change) the cascade's matrix stays exactly the same.
+//
+// The static casters are rendered into a cache array only when a cascade's matrix changed. Every frame the
+// cached depth is blitted into the shadow map array the shaders sample, and the dynamic casters are drawn on
+// top of it. Rendering is left to the caller (a RenderQueue, with bindCache()/bindShadowMap() in its pass
+// setup), so both kinds of caster show up as their own passes in the GPU profiler.
+class CascadedShadows
+{
+public:
+    static const unsigned int CASCADES = 3;
+    static const unsigned int RESOLUTION = 1024;
+    static const unsigned int SNAP_TEXELS = RESOLUTION / 16;
+    // after the material, point light and cluster units
+    static const unsigned int TEXTURE_UNIT = 7;
+
+    // with caching off the static casters are re-rendered every frame, for comparison
+    bool caching = true;
+
+    CascadedShadows(float shadowDistance = 20.0f) : shadowDistance(shadowDistance)
+    {
+        // no cascade matches the first frame's matrices, so every cache starts out stale
+        for (glm::mat4 &lightSpace : lightSpaces)
+            lightSpace = glm::mat4(0.0f);
+        cacheArray = createArray(false);
+        shadowArray = createArray(true);
+        glGenFramebuffers(1, &cacheFBO);
+        glGenFramebuffers(1, &shadowFBO);
+        for (unsigned int fbo : {cacheFBO, shadowFBO})
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // points the program's dirShadowMap sampler at TEXTURE_UNIT
+    void attach(Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("dirShadowMap"_uniform, TEXTURE_UNIT);
+    }
+
+    // everything that casts shadows, in world space; the depth range of the cascades
+    void setSceneBounds(const Bounds &bounds)
+    {
+        sceneBounds = bounds;
+    }
+
+    // fits the cascades to the camera and works out which of them need their static casters re-rendered
+    void update(const glm::vec3 &cameraPosition, const glm::vec3 &cameraFront, float fovY, float aspect, float nearPlane,
+                const glm::vec3 &lightDirection)
+    {
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+        // depth range of the scene along the light
+        float minZ = 1.0e30f, maxZ = -1.0e30f;
+        for (unsigned int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point((corner & 1) ? sceneBounds.Max.x : sceneBounds.Min.x, (corner & 2) ? sceneBounds.Max.y : sceneBounds.Min.y,
+                            (corner & 4) ? sceneBounds.Max.z : sceneBounds.Min.z);
+            float z = (lightView * glm::vec4(point, 1.0f)).z;
+            minZ = std::min(minZ, z);
+            maxZ = std::max(maxZ, z);
+        }
+
+        // practical split scheme: halfway between logarithmic and uniform splits
+        float tanY = std::tan(0.5f * fovY), tanX = tanY * aspect;
+        float sliceStart = nearPlane;
+        for (unsigned int cascade = 0; cascade < CASCADES; cascade++)
+        {
+            float fraction = (float)(cascade + 1) / CASCADES;
+            float sliceEnd = 0.5f * nearPlane * std::pow(shadowDistance / nearPlane, fraction) +
+                             0.5f * (nearPlane + (shadowDistance - nearPlane) * fraction);
+            splits[cascade] = sliceEnd;
+
+            // the sphere around the frustum slice, centered on the view axis
+            float middle = 0.5f * (sliceStart + sliceEnd);
+            float radius = glm::length(glm::vec3(sliceEnd * tanX, sliceEnd * tanY, sliceEnd - middle));
+            glm::vec3 center = cameraPosition + glm::normalize(cameraFront) * middle;
+
+            // snapping by a whole number of texels also keeps the static and dynamic casters texel aligned
+            float step = 2.0f * SNAP_TEXELS * radius / (RESOLUTION - 2.0f * SNAP_TEXELS);
+            float extent = radius + step;
+            glm::vec4 lightCenter = lightView * glm::vec4(center, 1.0f);
+            float x = std::round(lightCenter.x / step) * step, y = std::round(lightCenter.y / step) * step;
+            glm::mat4 projection = glm::ortho(x - extent, x + extent, y - extent, y + extent, -maxZ - 1.0f, -minZ + 1.0f);
+            glm::mat4 lightSpace = projection * lightView;
+
+            stale[cascade] = !caching || std::memcmp(&lightSpace, &lightSpaces[cascade], sizeof(glm::mat4)) != 0;
+            lightSpaces[cascade] = lightSpace;
+            texelSizes[cascade] = 2.0f * extent / RESOLUTION;
+            sliceStart = sliceEnd;
+        }
+        for (unsigned int cascade = 0; cascade < CASCADES; cascade++)
+            if (stale[cascade])
+                staticRenders++;
+        frames++;
+    }
+
+    // whether the cascade's static casters have to be rendered into the cache this frame
+    bool isStale(unsigned int cascade) const
+    {
+        return stale[cascade];
+    }
+
+    const glm::mat4 &lightSpace(unsigned int cascade) const
+    {
+        return lightSpaces[cascade];
+    }
+
+    // binds a cascade of the static cache for rendering and clears it
+    void bindCache(unsigned int cascade)
+    {
+        bindLayer(cacheFBO, cacheArray, cascade);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // copies the static depth of every cascade into the shadow maps; call once per frame, after the cache passes
+    void composite()
+    {
+        GpuProfiler::instance().begin("shadow composite");
+        for (unsigned int cascade = 0; cascade < CASCADES; cascade++)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, cacheFBO);
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cacheArray, 0, cascade);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFBO);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowArray, 0, cascade);
+            glBlitFramebuffer(0, 0, RESOLUTION, RESOLUTION, 0, 0, RESOLUTION, RESOLUTION, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GpuProfiler::instance().end();
+    }
+
+    // binds a cascade of the shadow maps for drawing the dynamic casters over the composited static ones
+    void bindShadowMap(unsigned int cascade)
+    {
+        bindLayer(shadowFBO, shadowArray, cascade);
+    }
+
+    // the cascades as the shaders read them from the Lights block
+    void describe(LightsBlock &lights) const
+    {
+        // from clip space to shadow map texture coordinates and depth
+        glm::mat4 toTexture = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+        for (unsigned int cascade = 0; cascade < CASCADES; cascade++)
+        {
+            lights.cascadeMatrices[cascade] = toTexture * lightSpaces[cascade];
+            lights.cascadeSplits[cascade] = splits[cascade];
+            lights.cascadeTexelSizes[cascade] = texelSizes[cascade];
+        }
+        lights.dirShadows = true;
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowArray);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void release()
+    {
+        glDeleteFramebuffers(1, &cacheFBO);
+        glDeleteFramebuffers(1, &shadowFBO);
+        glDeleteTextures(1, &cacheArray);
+        glDeleteTextures(1, &shadowArray);
+    }
+
+    void printStats() const
+    {
+        if (frames == 0)
+            return;
+        std::cout << "CascadedShadows: " << CASCADES << " cascades of " << RESOLUTION << "x" << RESOLUTION << ", static casters re-rendered "
+                  << staticRenders << " times in " << frames << " frames (" << (caching ? "cached" : "uncached") << ")" << std::endl;
+    }
+
+private:
+    float shadowDistance;
+    Bounds sceneBounds;
+    glm::mat4 lightSpaces[CASCADES];
+    float splits[CASCADES];
+    float texelSizes[CASCADES];
+    bool stale[CASCADES];
+    unsigned int cacheArray = 0, shadowArray = 0;
+    unsigned int cacheFBO = 0, shadowFBO = 0;
+    unsigned int staticRenders = 0;
+    unsigned int frames = 0;
+
+    static unsigned int createArray(bool comparison)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, RESOLUTION, RESOLUTION, CASCADES, 0, GL_DEPTH_COMPONENT,
+                     GL_UNSIGNED_INT, NULL);
+        // with comparison, sampler2DArrayShadow gets 2x2 percentage closer filtering from the linear filter
+        GLint filter = comparison ? GL_LINEAR : GL_NEAREST;
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (comparison)
+        {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    static void bindLayer(unsigned int fbo, unsigned int array, unsigned int layer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, array, 0, layer);
+        glViewport(0, 0, RESOLUTION, RESOLUTION);
+    }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef CONE_STEP_MAP_H
+#define CONE_STEP_MAP_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Relaxed cone step maps (Policarpo and Oliveira, GPU Gems 3 chapter 18) for ConeStepMapping in the normal mapping
+// shaders. A depth map (0 at the top of the surface, 1 at the bottom, as ParallaxMapping reads it) gets a cone per
+// texel: the widest upward cone from the texel's surface point inside which any ray coming from above crosses
+// the surface at most once, entering the solid and not leaving it again before the cone's apex. A ray can then
+// jump to the cone's boundary in a single step; it overshoots into the solid at most once and a short binary
+// search finds the intersection.
+//
+// The cone ratio (texture space distance per unit of depth, at most 1) is stored as its square root for
+// precision at narrow cones, next to the depth:
+//
+//     red     depth
+//     green   sqrt(cone ratio)
+class ConeStepMap
+{
+public:
+    // how far the search for a texel's cone looks, in texels; wider cones are clamped to this radius, which keeps
+    // them conservative and the build time bounded
+    static const int SEARCH_RADIUS = 48;
+    // ConeStepMapping stops this close above the surface, a step of an 8 bit depth map
+    static constexpr float CONVERGED = 1.0f / 255.0f;
+    // step limits of ConeStepMapping in the shaders (CONE_STEPS, BINARY_STEPS)
+    static const int CONE_STEPS = 12;
+    static const int BINARY_STEPS = 4;
+    // the narrowest cone it steps with, so a ray still advances where the map stores a zero ratio
+    static constexpr float MIN_CONE_RATIO = 1.0f / 1024.0f;
+
+    // replaces the green channel of an RGBA8 depth map (depth in red) with the square root of its relaxed cone
+    // ratios; rows are split between the hardware threads
+    static void build(unsigned char *rgba, int width, int height)
+    {
+        std::vector<float> depths(width * height);
+        for (int i = 0; i < width * height; i++)
+            depths[i] = rgba[4 * i] / 255.0f;
+
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        auto buildRows = [&](unsigned int first) {
+            for (int y = first; y < height; y += threadCount)
+                for (int x = 0; x < width; x++)
+                {
+                    float ratio = relaxedConeRatio(depths, width, height, x, y);
+                    // rounded down, a narrower cone is still a valid one
+                    rgba[4 * (y * width + x) + 1] = (unsigned char)(std::sqrt(ratio) * 255.0f);
+                }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.emplace_back(buildRows, i);
+        buildRows(0);
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    // CPU models of the shaders' ray marches for --bench-parallax, sampling a map with bilinear filtering and
+    // counting texture fetches. Both return the texture coordinates where the ray meets the surface.
+    struct Trace
+    {
+        glm::vec2 texCoords;
+        unsigned int fetches = 0;
+    };
+
+    // one level of the map as the shaders sample it, interleaved red/green floats as decodeBC5Level() returns them:
+    // channel 0 is the depth, 1 the square root of the cone ratio
+    struct Sampler
+    {
+        const float *rg;
+        int width, height;
+
+        float operator()(glm::vec2 texCoords, int channel) const
+        {
+            glm::vec2 position = texCoords * glm::vec2(width, height) - 0.5f;
+            int x = (int)std::floor(position.x), y = (int)std::floor(position.y);
+            float fx = position.x - x, fy = position.y - y;
+            auto texelAt = [this, channel](int tx, int ty) {
+                tx %= width;
+                ty %= height;
+                return rg[2 * ((tx < 0 ? tx + width : tx) + (ty < 0 ? ty + height : ty) * width) + channel];
+            };
+            float top = texelAt(x, y) * (1.0f - fx) + texelAt(x + 1, y) * fx;
+            float bottom = texelAt(x, y + 1) * (1.0f - fx) + texelAt(x + 1, y + 1) * fx;
+            return top * (1.0f - fy) + bottom * fy;
+        }
+    };
+
+    // ParallaxMapping: steep parallax with 8 to 32 layers and linear interpolation between the last two
+    static Trace traceLinear(const Sampler &sample, glm::vec2 texCoords, glm::vec3 viewDir, float heightScale)
+    {
+        Trace trace;
+        float numLayers = 32.0f + (8.0f - 32.0f) * std::abs(viewDir.z);
+        float layerDepth = 1.0f / numLayers;
+        float currentLayerDepth = 0.0f;
+        glm::vec2 deltaTexCoords = glm::vec2(viewDir) / viewDir.z * heightScale / numLayers;
+        glm::vec2 currentTexCoords = texCoords;
+        float currentDepthMapValue = sample(currentTexCoords, 0);
+        trace.fetches++;
+        while (currentLayerDepth < currentDepthMapValue)
+        {
+            currentTexCoords -= deltaTexCoords;
+            currentDepthMapValue = sample(currentTexCoords, 0);
+            trace.fetches++;
+            currentLayerDepth += layerDepth;
+        }
+        glm::vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+        float afterDepth = currentDepthMapValue - currentLayerDepth;
+        float beforeDepth = sample(prevTexCoords, 0) - currentLayerDepth + layerDepth;
+        trace.fetches++;
+        float weight = afterDepth / (afterDepth - beforeDepth);
+        trace.texCoords = prevTexCoords * weight + currentTexCoords * (1.0f - weight);
+        return trace;
+    }
+
+    // ConeStepMapping
+    static Trace traceConeStep(const Sampler &sample, glm::vec2 texCoords, glm::vec3 viewDir, float heightScale,
+                               int coneSteps = CONE_STEPS, int binarySteps = BINARY_STEPS)
+    {
+        Trace trace;
+        glm::vec3 rayStep(-glm::vec2(viewDir) / viewDir.z * heightScale, 1.0f);
+        float rayRatio = glm::length(glm::vec2(rayStep));
+        glm::vec3 position(texCoords, 0.0f);
+        glm::vec3 lastStep(0.0f);
+        float height = 1.0f;
+        for (int i = 0; i < coneSteps && height >= CONVERGED; i++)
+        {
+            glm::vec2 at(position);
+            height = sample(at, 0) - position.z;
+            float coneRoot = sample(at, 1);
+            trace.fetches++;
+            if (height >= CONVERGED)
+            {
+                float coneRatio = std::max(coneRoot * coneRoot, MIN_CONE_RATIO);
+                lastStep = rayStep * (coneRatio * height / (rayRatio + coneRatio));
+                position += lastStep;
+            }
+        }
+        if (height < 0.0f)
+        {
+            glm::vec3 range = 0.5f * lastStep;
+            position -= range;
+            for (int i = 0; i < binarySteps; i++)
+            {
+                range *= 0.5f;
+                trace.fetches++;
+                if (position.z < sample(glm::vec2(position), 0))
+                    position += range;
+                else
+                    position -= range;
+            }
+        }
+        trace.texCoords = glm::vec2(position);
+        return trace;
+    }
+
+private:
+    // the depth map wraps like the GL_REPEAT textures it is sampled from
+    static float depthAt(const std::vector<float> &depths, int width, int height, int x, int y)
+    {
+        x %= width;
+        y %= height;
+        return depths[(x < 0 ? x + width : x) + (y < 0 ? y + height : y) * width];
+    }
+
+    // the cone ratio of texel (x, y): for every higher texel q, the ray from the top of the volume above (x, y)
+    // through q's surface point is followed on until it leaves the solid; the cone may not contain that exit
+    static float relaxedConeRatio(const std::vector<float> &depths, int width, int height, int x, int y)
+    {
+        float depth = depthAt(depths, width, height, x, y);
+        if (depth <= 0.0f)
+            return 1.0f;
+        // texture space size of a texel along the longer side; distances in texels are scaled by it per axis
+        float texel = 1.0f / std::max(width, height);
+        glm::vec2 texelSize(1.0f / width, 1.0f / height);
+        float best = std::min(1.0f, SEARCH_RADIUS * texel / depth);
+
+        for (int radius = 1; radius <= SEARCH_RADIUS; radius++)
+        {
+            // every texel of this ring and beyond is further away than the best cone allows
+            if (radius * texel > best * depth)
+                break;
+            for (int dy = -radius; dy <= radius; dy++)
+            {
+                // the ring's rows at the top and bottom, only its two ends in between
+                int stride = (dy == -radius || dy == radius) ? 1 : 2 * radius;
+                for (int dx = -radius; dx <= radius; dx += stride)
+                {
+                    float targetDepth = depthAt(depths, width, height, x + dx, y + dy);
+                    // the ray leaves the solid below the target; only targets above this texel can limit its cone
+                    if (targetDepth >= depth)
+                        continue;
+                    glm::vec2 offset = glm::vec2(dx, dy) * texelSize;
+                    float distance = glm::length(offset);
+                    // the exit is at least as far out and as deep as the target itself
+                    if (distance >= best * (depth - targetDepth))
+                        continue;
+                    if (targetDepth <= 0.0f)
+                    {
+                        // a grazing ray along the top, which leaves the solid right at the target
+                        best = distance / depth;
+                        continue;
+                    }
+                    // texture space offset per unit of depth along the ray, followed a texel at a time up to the depth
+                    // beyond which an exit can't narrow the cone any more
+                    glm::vec2 slope = offset / targetDepth;
+                    float slopeLength = distance / targetDepth;
+                    float step = texel / slopeLength;
+                    float lastDepth = best * depth / (slopeLength + best);
+                    for (float t = targetDepth + step; t < lastDepth; t += step)
+                    {
+                        glm::vec2 texelOffset = slope * t / texelSize;
+                        float surface = depthAt(depths, width, height, x + (int)std::lround(texelOffset.x), y + (int)std::lround(texelOffset.y));
+                        if (surface > t)
+                        {
+                            best = std::min(best, slopeLength * t / (depth - t));
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        return best;
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/point_light_buffer.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+// The deferred alternative to lighting every fragment in the forward programs. The props are first drawn into a
+// G-buffer with programs that only write their surface attributes:
+//
+//     attachment 0   RGBA8     albedo (tinted diffuse texture), specular intensity in alpha
+//     attachment 1   RG16F     world space normal, octahedral encoded
+//     depth          DEPTH24   reconstructed into world positions with the inverse view projection
+//
+// light() then shades each pixel once: a full screen pass for the directional light and the spotlight, and an
+// instanced light volume per point light, blended additively, that only touches the pixels within the light's
+// radius. Shading cost therefore follows the number of lit pixels rather than drawn fragments times lights. All
+// materials share one shininess, which isn't stored per pixel.
+class DeferredRenderer
+{
+public:
+    // the full screen pass, attach the Lights uniform block to it
+    Shader lighting;
+    // the point light volumes, attach the PointLightBuffer to it
+    Shader pointLighting;
+
+    DeferredRenderer(unsigned int width, unsigned int height)
+        : lighting("resources/shaders/deferredLighting.vs", "resources/shaders/deferredLighting.fs"),
+          pointLighting("resources/shaders/deferredPointLight.vs", "resources/shaders/deferredPointLight.fs"),
+          width(width), height(height)
+    {
+        glGenFramebuffers(1, &gBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        albedoSpecular = attachTexture(GL_COLOR_ATTACHMENT0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = attachTexture(GL_COLOR_ATTACHMENT1, GL_RG16F, GL_RG, GL_FLOAT);
+        depth = attachTexture(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+        const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED:: G-buffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (Shader *program : {&lighting, &pointLighting})
+        {
+            program->use();
+            program->setInt("gAlbedoSpecular"_uniform, 0);
+            program->setInt("gNormal"_uniform, 1);
+            program->setInt("gDepth"_uniform, 2);
+        }
+        // the full screen triangle comes from gl_VertexID, but core profile still wants a VAO bound
+        glGenVertexArrays(1, &emptyVAO);
+        buildLightVolume();
+    }
+
+    // reallocates the G-buffer attachments at a new size, e.g. when the render resolution changes
+    void resize(unsigned int newWidth, unsigned int newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+        const unsigned int textures[] = {albedoSpecular, normal, depth};
+        glDeleteTextures(3, textures);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        albedoSpecular = attachTexture(GL_COLOR_ATTACHMENT0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = attachTexture(GL_COLOR_ATTACHMENT1, GL_RG16F, GL_RG, GL_FLOAT);
+        depth = attachTexture(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED:: G-buffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds the G-buffer for the geometry pass and clears it
+    void beginGeometry()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glEnable(GL_DEPTH_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // shades the G-buffer into framebuffer, which is cleared to the background color first; leaves framebuffer
+    // bound, depth testing and blending disabled and GL_TEXTURE0 active
+    void light(unsigned int framebuffer, const PointLightBuffer &pointLights, const glm::mat4 &view, const glm::mat4 &projection,
+               const glm::vec3 &viewPosition, float shininess)
+    {
+        GpuProfiler::instance().begin("deferred lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        const unsigned int textures[] = {albedoSpecular, normal, depth};
+        for (unsigned int unit = 0; unit < 3; unit++)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, textures[unit]);
+        }
+        pointLights.bind();
+
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        lighting.use();
+        lighting.setMat4("inverseViewProjection"_uniform, inverseViewProjection);
+        lighting.setMat4("view"_uniform, view);
+        lighting.setVec3("viewPosition"_uniform, viewPosition);
+        lighting.setFloat("shininess"_uniform, shininess);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        if (pointLights.count() > 0)
+        {
+            // back faces only, so a volume the camera is inside of still covers its pixels exactly once
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glFrontFace(GL_CCW);
+            pointLighting.use();
+            pointLighting.setMat4("view"_uniform, view);
+            pointLighting.setMat4("projection"_uniform, projection);
+            pointLighting.setMat4("inverseViewProjection"_uniform, inverseViewProjection);
+            pointLighting.setVec3("viewPosition"_uniform, viewPosition);
+            pointLighting.setFloat("shininess"_uniform, shininess);
+            glBindVertexArray(volumeVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_SHORT, 0, pointLights.count());
+            glCullFace(GL_BACK);
+            glDisable(GL_CULL_FACE);
+            glDisable(GL_BLEND);
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        GpuProfiler::instance().end();
+    }
+
+    void release()
+    {
+        const unsigned int textures[] = {albedoSpecular, normal, depth};
+        glDeleteTextures(3, textures);
+        glDeleteFramebuffers(1, &gBuffer);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteVertexArrays(1, &volumeVAO);
+        glDeleteBuffers(1, &volumeVBO);
+        glDeleteBuffers(1, &volumeEBO);
+    }
+
+private:
+    unsigned int width, height;
+    unsigned int gBuffer = 0;
+    unsigned int albedoSpecular = 0, normal = 0, depth = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int volumeVAO = 0, volumeVBO = 0, volumeEBO = 0;
+    unsigned int volumeIndexCount = 0;
+
+    unsigned int attachTexture(GLenum attachment, GLint internalFormat, GLenum format, GLenum type)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // an icosahedron subdivided once (80 triangles), scaled so its faces enclose the unit sphere
+    void buildLightVolume()
+    {
+        const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+        std::vector<glm::vec3> positions = {
+            {-1.0f, t, 0.0f}, {1.0f, t, 0.0f}, {-1.0f, -t, 0.0f}, {1.0f, -t, 0.0f},
+            {0.0f, -1.0f, t}, {0.0f, 1.0f, t}, {0.0f, -1.0f, -t}, {0.0f, 1.0f, -t},
+            {t, 0.0f, -1.0f}, {t, 0.0f, 1.0f}, {-t, 0.0f, -1.0f}, {-t, 0.0f, 1.0f}};
+        std::vector<uint16_t> indices = {
+            0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+            3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+        for (glm::vec3 &position : positions)
+            position = glm::normalize(position);
+
+        // split every triangle into four, sharing the new edge midpoints between neighbours
+        std::map<std::pair<uint16_t, uint16_t>, uint16_t> midpoints;
+        auto midpoint = [&positions, &midpoints](uint16_t a, uint16_t b) {
+            std::pair<uint16_t, uint16_t> edge(std::min(a, b), std::max(a, b));
+            auto found = midpoints.find(edge);
+            if (found != midpoints.end())
+                return found->second;
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            uint16_t index = positions.size() - 1;
+            midpoints[edge] = index;
+            return index;
+        };
+        std::vector<uint16_t> subdivided;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            uint16_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            uint16_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            const uint16_t triangles[] = {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca};
+            subdivided.insert(subdivided.end(), triangles, triangles + 12);
+        }
+
+        // the flat faces cut inside the sphere; push them out to the unit radius
+        float inscribed = 1.0f;
+        for (size_t i = 0; i < subdivided.size(); i += 3)
+        {
+            glm::vec3 a = positions[subdivided[i]], b = positions[subdivided[i + 1]], c = positions[subdivided[i + 2]];
+            inscribed = std::min(inscribed, glm::dot(glm::normalize(glm::cross(b - a, c - a)), a));
+        }
+        for (glm::vec3 &position : positions)
+            position /= inscribed;
+
+        volumeIndexCount = subdivided.size();
+        glGenVertexArrays(1, &volumeVAO);
+        glGenBuffers(1, &volumeVBO);
+        glGenBuffers(1, &volumeEBO);
+        glBindVertexArray(volumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, subdivided.size() * sizeof(uint16_t), subdivided.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+        glBindVertexArray(0);
+    }
+};
+
+#endif
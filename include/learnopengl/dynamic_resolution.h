@@ -0,0 +1,104 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Picks the scale of the internal render resolution, relative to the window, from the measured GPU time of the
+// frame, so the frame stays within a time budget. Most of the frame's cost follows the number of pixels shaded,
+// the square of the scale, so the scale that just meets a time is the current one times the square root of the
+// ratio of that time to the measured one. Measurements are smoothed exponentially, and the scale moves in steps
+// of STEP: down as soon as the smoothed time is over the budget, up only once it is below headroom times the
+// budget, so it doesn't oscillate around a step boundary. The times come from the GpuProfiler, FRAMES_IN_FLIGHT
+// frames late, so after every change the next SETTLE_FRAMES measurements, which still include frames at the old
+// scale, are ignored and smoothing starts over.
+class DynamicResolution
+{
+public:
+    static constexpr float STEP = 0.05f;
+    static const unsigned int SETTLE_FRAMES = 4;
+    // measurements smoothed before the first decision after a change
+    static const unsigned int MIN_SAMPLES = 8;
+    static constexpr double SMOOTHING = 0.1;
+
+    // GPU time budget of a frame in milliseconds, 0 keeps the scale fixed
+    float targetMilliseconds = 0.0f;
+    float minScale = 0.5f, maxScale = 1.0f;
+    float headroom = 0.85f;
+
+    // a starting scale outside [minScale, maxScale] widens the range, so the first decision doesn't jump to it
+    DynamicResolution(float targetMilliseconds = 0.0f, float scale = 1.0f)
+        : targetMilliseconds(targetMilliseconds), currentScale(scale)
+    {
+        minScale = std::min(minScale, scale);
+        maxScale = std::max(maxScale, scale);
+    }
+
+    float scale() const
+    {
+        return currentScale;
+    }
+
+    // feeds the GPU time of a completed frame, negative when it isn't known; returns whether the scale changed
+    bool update(double gpuMilliseconds)
+    {
+        frames++;
+        scaleSum += currentScale;
+        lowestScale = std::min(lowestScale, currentScale);
+        if (targetMilliseconds <= 0.0f || gpuMilliseconds < 0.0)
+            return false;
+        if (settle > 0)
+        {
+            settle--;
+            return false;
+        }
+        smoothed = samples == 0 ? gpuMilliseconds : smoothed + SMOOTHING * (gpuMilliseconds - smoothed);
+        if (++samples < MIN_SAMPLES)
+            return false;
+
+        float next = currentScale;
+        if (smoothed > targetMilliseconds)
+            next = quantize(currentScale * (float)std::sqrt(targetMilliseconds / smoothed));
+        else if (smoothed < headroom * targetMilliseconds)
+            next = std::max(currentScale, quantize(currentScale * (float)std::sqrt(headroom * targetMilliseconds / smoothed)));
+        // a time over the budget at the lowest step still has to move the scale by a whole step
+        if (smoothed > targetMilliseconds && next >= currentScale)
+            next = quantize(currentScale - STEP);
+        next = std::min(std::max(next, minScale), maxScale);
+        if (std::fabs(next - currentScale) < 0.5f * STEP)
+            return false;
+        currentScale = next;
+        changes++;
+        settle = SETTLE_FRAMES;
+        samples = 0;
+        return true;
+    }
+
+    void printStats() const
+    {
+        if (targetMilliseconds <= 0.0f || frames == 0)
+            return;
+        std::cout << "DynamicResolution: target " << targetMilliseconds << " ms, render scale " << scaleSum / frames
+                  << " on average (lowest " << lowestScale << ", last " << currentScale << "), " << changes << " changes over "
+                  << frames << " frames" << std::endl;
+    }
+
+private:
+    float currentScale;
+    double smoothed = 0.0;
+    unsigned int samples = 0;
+    unsigned int settle = 0;
+    unsigned long long frames = 0;
+    unsigned int changes = 0;
+    double scaleSum = 0.0;
+    float lowestScale = 1.0f;
+
+    // rounds down to a whole number of steps; the small bias keeps exact steps from rounding to the one below
+    static float quantize(float scale)
+    {
+        return std::floor(scale / STEP + 1.0e-3f) * STEP;
+    }
+};
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Measures the GPU time of named sections of the frame with GL_TIME_ELAPSED queries. Every pass owns one query
+// per frame in flight; a query is only read back when its frame comes around again, by which time the GPU has
+// normally finished it, so the profiler never waits on the GPU. Results that still aren't available are dropped
+// rather than waited for. Time elapsed queries can't nest, so passes have to be sequential.
+class GpuProfiler
+{
+public:
+    // how many frames late beginFrame() collects a frame's results
+    static const unsigned int FRAMES_IN_FLIGHT = 2;
+
+    static GpuProfiler &instance()
+    {
+        static GpuProfiler profiler;
+        return profiler;
+    }
+
+    struct Stats
+    {
+        std::string name;
+        size_t frames = 0;
+        double min = 0.0, average = 0.0, p99 = 0.0; // milliseconds
+    };
+
+    // collects the results of the queries this frame is about to reuse
+    void beginFrame()
+    {
+        slot = frame % FRAMES_IN_FLIGHT;
+        completedFrameTime = 0.0;
+        bool complete = false;
+        for (Pass &pass : passes)
+        {
+            if (!pass.pending[slot])
+                continue;
+            pass.pending[slot] = false;
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                droppedSamples++;
+                completedFrameTime = -1.0;
+                continue;
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+            pass.samples.push_back(nanoseconds / 1.0e6);
+            if (completedFrameTime >= 0.0)
+                completedFrameTime += nanoseconds / 1.0e6;
+            complete = true;
+        }
+        if (!complete)
+            completedFrameTime = -1.0;
+    }
+
+    // the GPU time of all sections of the frame whose results beginFrame() just collected, FRAMES_IN_FLIGHT frames
+    // ago, in milliseconds; negative if that frame has no complete set of results
+    double completedFrameMilliseconds() const
+    {
+        return completedFrameTime;
+    }
+
+    void begin(const char *name)
+    {
+        if (active >= 0)
+        {
+            std::cout << "ERROR::GPU_PROFILER:: pass " << name << " begins inside " << passes[active].name << std::endl;
+            return;
+        }
+        active = passIndex(name);
+        glBeginQuery(GL_TIME_ELAPSED, passes[active].queries[slot]);
+    }
+
+    void end()
+    {
+        if (active < 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        passes[active].pending[slot] = true;
+        active = -1;
+    }
+
+    void endFrame()
+    {
+        frame++;
+    }
+
+    std::vector<Stats> stats() const
+    {
+        std::vector<Stats> result;
+        for (const Pass &pass : passes)
+        {
+            Stats entry;
+            entry.name = pass.name;
+            entry.frames = pass.samples.size();
+            if (!pass.samples.empty())
+            {
+                std::vector<double> sorted(pass.samples);
+                std::sort(sorted.begin(), sorted.end());
+                double sum = 0.0;
+                for (double sample : sorted)
+                    sum += sample;
+                entry.min = sorted.front();
+                entry.average = sum / sorted.size();
+                entry.p99 = sorted[std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()))];
+            }
+            result.push_back(entry);
+        }
+        return result;
+    }
+
+    void report() const
+    {
+        std::cout << "GpuProfiler: " << frame << " frames, " << droppedSamples << " samples dropped (not ready in time)" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        for (const Stats &entry : stats())
+            std::cout << "  " << std::left << std::setw(16) << entry.name << std::right << " min " << entry.min
+                      << " ms  avg " << entry.average << " ms  p99 " << entry.p99 << " ms  (" << entry.frames << " frames)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+
+    bool writeCSV(const std::string &path) const
+    {
+        std::ofstream out(path);
+        out << "pass,frames,min_ms,avg_ms,p99_ms\n";
+        for (const Stats &entry : stats())
+            out << entry.name << ',' << entry.frames << ',' << entry.min << ',' << entry.average << ',' << entry.p99 << '\n';
+        if (!out)
+        {
+            std::cout << "ERROR::GPU_PROFILER:: failed to write " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // forgets all samples, including those of queries still in flight, e.g. after warm-up frames
+    void reset()
+    {
+        for (Pass &pass : passes)
+        {
+            pass.samples.clear();
+            std::fill(pass.pending, pass.pending + FRAMES_IN_FLIGHT, false);
+        }
+        droppedSamples = 0;
+    }
+
+    void release()
+    {
+        for (Pass &pass : passes)
+            glDeleteQueries(FRAMES_IN_FLIGHT, pass.queries);
+        passes.clear();
+    }
+
+private:
+
+    struct Pass
+    {
+        std::string name;
+        unsigned int queries[FRAMES_IN_FLIGHT];
+        bool pending[FRAMES_IN_FLIGHT];
+        std::vector<double> samples;
+    };
+
+    std::vector<Pass> passes;
+    unsigned int frame = 0;
+    unsigned int slot = 0;
+    int active = -1;
+    unsigned int droppedSamples = 0;
+    double completedFrameTime = -1.0;
+
+    GpuProfiler() = default;
+
+    // passes are few, a linear search beats hashing the name
+    int passIndex(const char *name)
+    {
+        for (size_t i = 0; i < passes.size(); i++)
+            if (passes[i].name == name)
+                return i;
+        Pass pass;
+        pass.name = name;
+        glGenQueries(FRAMES_IN_FLIGHT, pass.queries);
+        std::fill(pass.pending, pass.pending + FRAMES_IN_FLIGHT, false);
+        passes.push_back(pass);
+        return passes.size() - 1;
+    }
+};
+
+#endif
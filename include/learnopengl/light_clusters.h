@@ -0,0 +1,303 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/light_uniform_buffer.h>
+#include <learnopengl/point_light_buffer.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Clustered light culling for the forward programs. The view frustum is divided into TILES_X x TILES_Y screen
+// tiles and SLICES depth slices, spaced exponentially so clusters stay roughly cube shaped. Every frame the point
+// lights are assigned on the CPU to the clusters their sphere touches; the slices are split between a pool of
+// worker threads (and the calling thread), which each own the clusters of their slices and need no locking. The
+// result goes to two texture buffers the fragment shaders read:
+//
+//     clusterGrid     RG32UI   per cluster, first entry in clusterLights and light count
+//     clusterLights   R32UI    point light indices, cluster after cluster
+//
+// so each fragment only loops over the lights of its own cluster (ClusterLightRange in the shaders).
+class LightClusters
+{
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // after the material units and PointLightBuffer::TEXTURE_UNIT
+    static const unsigned int GRID_UNIT = 5;
+    static const unsigned int LIGHTS_UNIT = 6;
+
+    explicit LightClusters(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        clusterLights.resize(CLUSTER_COUNT);
+        bounds.resize(CLUSTER_COUNT);
+        // the calling thread takes a share of the slices as well
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back(&LightClusters::workerLoop, this, i);
+        glGenBuffers(2, buffers);
+        glGenTextures(2, textures);
+    }
+
+    ~LightClusters()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        startCondition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // points the program's cluster samplers at GRID_UNIT and LIGHTS_UNIT
+    void attach(Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("clusterGrid"_uniform, GRID_UNIT);
+        shader.setInt("clusterLights"_uniform, LIGHTS_UNIT);
+    }
+
+    // assigns the lights to the clusters of the given camera and uploads the lists; width and height are those of
+    // the framebuffer the clusters are looked up in
+    void build(const std::vector<PointLightData> &lights, const glm::mat4 &view, float fovY, float aspect, float nearPlane,
+               float farPlane, unsigned int width, unsigned int height)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (fovY != frustum.fovY || aspect != frustum.aspect || nearPlane != frustum.nearPlane || farPlane != frustum.farPlane)
+            buildBounds(fovY, aspect, nearPlane, farPlane);
+        viewportSize = glm::vec2(width, height);
+
+        viewLights.resize(lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            glm::vec4 center = view * glm::vec4(lights[i].position, 1.0f);
+            viewLights[i] = glm::vec4(glm::vec3(center), lights[i].radius);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            finished = 0;
+        }
+        startCondition.notify_all();
+        assignSlices(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCondition.wait(lock, [this] { return finished == workers.size(); });
+        }
+
+        grid.resize(2 * CLUSTER_COUNT);
+        indices.clear();
+        unsigned int busiest = 0;
+        for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            grid[2 * cluster] = indices.size();
+            grid[2 * cluster + 1] = clusterLights[cluster].size();
+            indices.insert(indices.end(), clusterLights[cluster].begin(), clusterLights[cluster].end());
+            busiest = std::max(busiest, (unsigned int)clusterLights[cluster].size());
+        }
+        upload(0, GL_RG32UI, grid);
+        upload(1, GL_R32UI, indices);
+
+        last.lights = lights.size();
+        last.references = indices.size();
+        last.busiestCluster = busiest;
+        last.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        totals.references += last.references;
+        totals.busiestCluster = std::max(totals.busiestCluster, busiest);
+        totals.milliseconds += last.milliseconds;
+        frames++;
+    }
+
+    // the lookup parameters the shaders read from the Lights block
+    void describe(LightsBlock &lights) const
+    {
+        float logRange = std::log(frustum.farPlane / frustum.nearPlane);
+        lights.tileScale = glm::vec2(TILES_X, TILES_Y) / viewportSize;
+        lights.sliceScale = SLICES / logRange;
+        lights.sliceBias = -(float)SLICES * std::log(frustum.nearPlane) / logRange;
+        lights.tilesX = TILES_X;
+        lights.tilesY = TILES_Y;
+        lights.slices = SLICES;
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[0]);
+        glActiveTexture(GL_TEXTURE0 + LIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[1]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void release()
+    {
+        glDeleteTextures(2, textures);
+        glDeleteBuffers(2, buffers);
+    }
+
+    void printStats() const
+    {
+        if (frames == 0)
+            return;
+        std::cout << "LightClusters: " << last.lights << " point lights in " << CLUSTER_COUNT << " clusters on "
+                  << workers.size() + 1 << " threads, per frame " << (double)totals.references / frames
+                  << " light references (up to " << totals.busiestCluster << " in one cluster), built in "
+                  << totals.milliseconds / frames << " ms" << std::endl;
+    }
+
+private:
+    struct Stats
+    {
+        size_t lights = 0;
+        size_t references = 0;
+        unsigned int busiestCluster = 0;
+        double milliseconds = 0.0;
+    };
+
+    struct Frustum
+    {
+        float fovY = 0.0f, aspect = 0.0f, nearPlane = 0.0f, farPlane = 0.0f;
+    };
+
+    struct Box
+    {
+        glm::vec3 min, max;
+    };
+
+    // view space boxes around the clusters, index (slice * TILES_Y + y) * TILES_X + x
+    std::vector<Box> bounds;
+    // the depth range of every slice
+    float sliceDepths[SLICES + 1];
+    Frustum frustum;
+    glm::vec2 viewportSize = glm::vec2(1.0f);
+
+    // this frame's lights as view space center and radius
+    std::vector<glm::vec4> viewLights;
+    std::vector<std::vector<uint32_t>> clusterLights;
+    std::vector<uint32_t> grid;
+    std::vector<uint32_t> indices;
+    unsigned int buffers[2];
+    unsigned int textures[2];
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    unsigned int generation = 0;
+    unsigned int finished = 0;
+    bool stopping = false;
+
+    Stats last;
+    Stats totals;
+    unsigned int frames = 0;
+
+    void buildBounds(float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        frustum.fovY = fovY;
+        frustum.aspect = aspect;
+        frustum.nearPlane = nearPlane;
+        frustum.farPlane = farPlane;
+        for (unsigned int slice = 0; slice <= SLICES; slice++)
+            sliceDepths[slice] = nearPlane * std::pow(farPlane / nearPlane, (float)slice / SLICES);
+
+        float tanY = std::tan(0.5f * fovY), tanX = tanY * aspect;
+        for (unsigned int slice = 0; slice < SLICES; slice++)
+            for (unsigned int y = 0; y < TILES_Y; y++)
+                for (unsigned int x = 0; x < TILES_X; x++)
+                {
+                    // the eight corners of the tile's frustum between the slice's depths
+                    Box box = {glm::vec3(1.0e30f), glm::vec3(-1.0e30f)};
+                    for (unsigned int corner = 0; corner < 8; corner++)
+                    {
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / TILES_X;
+                        float ndcY = -1.0f + 2.0f * (y + ((corner >> 1) & 1)) / TILES_Y;
+                        float depth = sliceDepths[slice + (corner >> 2)];
+                        glm::vec3 point(ndcX * tanX * depth, ndcY * tanY * depth, -depth);
+                        box.min = glm::min(box.min, point);
+                        box.max = glm::max(box.max, point);
+                    }
+                    bounds[(slice * TILES_Y + y) * TILES_X + x] = box;
+                }
+    }
+
+    // the clusters of every participants'th slice, starting at slice participant
+    void assignSlices(unsigned int participant)
+    {
+        unsigned int participants = workers.size() + 1;
+        for (unsigned int slice = participant; slice < SLICES; slice += participants)
+        {
+            for (unsigned int cluster = slice * TILES_X * TILES_Y; cluster < (slice + 1) * TILES_X * TILES_Y; cluster++)
+                clusterLights[cluster].clear();
+            for (size_t light = 0; light < viewLights.size(); light++)
+            {
+                glm::vec3 center(viewLights[light]);
+                float radius = viewLights[light].w;
+                float nearest = -center.z - radius, farthest = -center.z + radius;
+                if (farthest < sliceDepths[slice] || nearest > sliceDepths[slice + 1])
+                    continue;
+                for (unsigned int cluster = slice * TILES_X * TILES_Y; cluster < (slice + 1) * TILES_X * TILES_Y; cluster++)
+                {
+                    glm::vec3 closest = glm::clamp(center, bounds[cluster].min, bounds[cluster].max);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius)
+                        clusterLights[cluster].push_back(light);
+                }
+            }
+        }
+    }
+
+    void workerLoop(unsigned int participant)
+    {
+        unsigned int seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [this, seen] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            assignSlices(participant);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished++;
+            }
+            doneCondition.notify_one();
+        }
+    }
+
+    void upload(unsigned int buffer, GLenum format, const std::vector<uint32_t> &data)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        // orphaned every frame; never empty, a texture buffer needs storage
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, data.size()) * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, data.size() * sizeof(uint32_t), data.data());
+        glBindTexture(GL_TEXTURE_BUFFER, textures[buffer]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[buffer]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif
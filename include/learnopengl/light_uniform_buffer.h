@@ -0,0 +1,116 @@
+#ifndef LIGHT_UNIFORM_BUFFER_H
+#define LIGHT_UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <cstring>
+
+// std140 image of the Lights uniform block declared in shader.fs and normalMappingShader.fs. Each vec3 shares its
+// 16 byte slot with the float that follows it in the GLSL struct (or with an explicit padding member), so there is
+// no implicit padding and the struct is copied into the buffer as is.
+struct LightsBlock
+{
+    struct Directional
+    {
+        glm::vec3 direction;
+        float padding0;
+        glm::vec3 ambient;
+        float padding1;
+        glm::vec3 diffuse;
+        float padding2;
+        glm::vec3 specular;
+        float padding3;
+    };
+    struct Spot
+    {
+        glm::vec3 position;
+        float cutOff;
+        glm::vec3 direction;
+        float outerCutOff;
+        glm::vec3 ambient;
+        float constant;
+        glm::vec3 diffuse;
+        float linear;
+        glm::vec3 specular;
+        float quadratic;
+    };
+
+    Directional dirLight;
+    Spot spotLight;
+    int spotLightOn; // a GLSL bool is 4 bytes in std140
+    // the point lights themselves are in the PointLightBuffer
+    int pointLightCount;
+    // how a fragment finds its cluster of LightClusters, see ClusterLightRange in the shaders
+    glm::vec2 tileScale;
+    float sliceScale;
+    float sliceBias;
+    int tilesX;
+    int tilesY;
+    int slices;
+    int clustered; // otherwise every fragment loops over all point lights
+    int padding[2];
+    // the directional light's CascadedShadows, see DirShadow in the shaders
+    glm::vec4 cascadeSplits;      // view depth at which each cascade ends
+    glm::vec4 cascadeTexelSizes;  // world size of a shadow map texel in each cascade
+    glm::mat4 cascadeMatrices[3]; // world space to shadow map texture coordinates and depth
+    int dirShadows;
+    int shadowPadding[3];
+};
+static_assert(sizeof(LightsBlock) == 432, "LightsBlock doesn't match the std140 layout of the Lights block");
+
+// One uniform buffer holding every light, bound to a fixed binding point that all lit programs read from.
+// update() is called once per frame and only touches the buffer when the lights actually changed.
+class LightUniformBuffer
+{
+public:
+    static const unsigned int BINDING_POINT = 0;
+
+    LightUniformBuffer()
+    {
+        std::memset((void *)&uploaded, 0, sizeof(uploaded));
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), &uploaded, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, UBO);
+    }
+
+    // connects the program's Lights block to the shared binding point
+    void attach(const Shader &shader) const
+    {
+        unsigned int blockIndex = glGetUniformBlockIndex(shader.ID, "Lights");
+        if (blockIndex == GL_INVALID_INDEX)
+        {
+            std::cout << "WARNING::LIGHTS:: program " << shader.ID << " has no Lights uniform block" << std::endl;
+            return;
+        }
+        glUniformBlockBinding(shader.ID, blockIndex, BINDING_POINT);
+    }
+
+    // returns whether the buffer had to be written
+    bool update(const LightsBlock &lights)
+    {
+        if (std::memcmp(&lights, &uploaded, sizeof(LightsBlock)) == 0)
+            return false;
+        uploaded = lights;
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightsBlock), &uploaded);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        return true;
+    }
+
+    void release()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+
+private:
+    unsigned int UBO = 0;
+    LightsBlock uploaded;
+};
+
+#endif
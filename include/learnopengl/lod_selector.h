@@ -0,0 +1,76 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <iostream>
+
+// Picks a level of detail from the fraction of the viewport height an object's bounding sphere covers. Every
+// level has a size below which the next coarser one takes over; an object only switches once its size is past
+// that threshold by the hysteresis margin, so one that hovers around a threshold doesn't pop back and forth.
+class LodSelector
+{
+public:
+    static const unsigned int MAX_LEVELS = 4;
+
+    // the fraction of the viewport height below which level i + 1 is used instead of level i
+    float thresholds[MAX_LEVELS - 1] = {0.25f, 0.12f, 0.06f};
+    float hysteresis = 0.15f;
+
+    // projected diameter of a bounding sphere as a fraction of the viewport height
+    static float screenSize(const glm::vec3 &center, float radius, const glm::vec3 &viewPosition, float fovY)
+    {
+        float distance = glm::length(center - viewPosition);
+        if (distance <= radius)
+            return 1.0f;
+        return radius / (distance * std::tan(0.5f * fovY));
+    }
+
+    // the level for an object of the given screen size that used previous in the last frame
+    unsigned int select(unsigned int previous, float size, unsigned int levelCount) const
+    {
+        unsigned int level = previous < levelCount ? previous : levelCount - 1;
+        while (level + 1 < levelCount && size < thresholds[level] * (1.0f - hysteresis))
+            level++;
+        while (level > 0 && size > thresholds[level - 1] * (1.0f + hysteresis))
+            level--;
+        return level;
+    }
+
+    void beginFrame()
+    {
+        for (unsigned int &count : lastFrame)
+            count = 0;
+        frames++;
+    }
+
+    // counts an object drawn at level this frame
+    void record(unsigned int level)
+    {
+        lastFrame[level]++;
+        totals[level]++;
+    }
+
+    const unsigned int *lastFrameCounts() const
+    {
+        return lastFrame;
+    }
+
+    void printStats() const
+    {
+        if (frames == 0)
+            return;
+        std::cout << "LodSelector: objects per frame by level";
+        for (unsigned int level = 0; level < MAX_LEVELS; level++)
+            std::cout << (level == 0 ? " " : ", ") << "LOD" << level << " " << (float)totals[level] / frames;
+        std::cout << std::endl;
+    }
+
+private:
+    unsigned int lastFrame[MAX_LEVELS] = {};
+    unsigned long long totals[MAX_LEVELS] = {};
+    unsigned int frames = 0;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef MATERIAL_LOD_H
+#define MATERIAL_LOD_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader_m.h>
+
+#include <iostream>
+
+// Per fragment level of detail for the normal mapped materials. Far away, or where a pixel covers many texels
+// (which includes grazing angles, where the texture coordinates change quickly along one screen axis), parallax
+// and normal mapping add little more than aliasing, so normalMappingShader.fs and gBufferNormalMapping.fs fall
+// back from parallax to plain normal mapping to the interpolated vertex normal. Each level fades out over a
+// distance range and over a range of texels per pixel, whichever is further along; in between, the parallax
+// offset and the mapped normal are blended towards the next level, and only once a level has faded out completely
+// is its work skipped.
+//
+// How many fragments of the parallax walls run each level is counted every COUNT_INTERVAL frames: the walls are
+// drawn again once per level with color and depth writes off, the shader discarding every fragment of another
+// level, inside a GL_SAMPLES_PASSED query. The results are read when the next count comes around, so counting
+// never waits on the GPU.
+class MaterialLod
+{
+public:
+    enum Level
+    {
+        Parallax,
+        NormalMapping,
+        Flat,
+        LEVELS
+    };
+    static const unsigned int COUNT_INTERVAL = 30;
+
+    // a level is fully used up to the start distance (world units) and start footprint (texels per pixel along
+    // the pixel's longer axis) and gone past the end of either
+    struct Fade
+    {
+        float startDistance, endDistance;
+        float startFootprint, endFootprint;
+    };
+    Fade parallax = {4.0f, 7.0f, 1.5f, 3.0f};
+    Fade normalMapping = {10.0f, 16.0f, 4.0f, 8.0f};
+
+    // with the LOD off every level stays fully in use
+    void disable()
+    {
+        parallax = normalMapping = {1.0e30f, 2.0e30f, 1.0e30f, 2.0e30f};
+    }
+
+    // sets the fade ranges of a normal mapping program, and switches counting off in it
+    void apply(Shader &shader) const
+    {
+        shader.setVec4("parallaxLod"_uniform, parallax.startDistance, parallax.endDistance, parallax.startFootprint, parallax.endFootprint);
+        shader.setVec4("normalLod"_uniform, normalMapping.startDistance, normalMapping.endDistance, normalMapping.startFootprint,
+                       normalMapping.endFootprint);
+        shader.setInt("materialLodCount"_uniform, -1);
+    }
+
+    // whether this frame counts fragments; collects the results of the last count if it does
+    bool beginFrame()
+    {
+        if (frame++ % COUNT_INTERVAL != 0)
+            return false;
+        if (queries[0] == 0)
+            glGenQueries(LEVELS, queries);
+        else if (pending)
+            collect();
+        return true;
+    }
+
+    // starts counting the fragments of a level; meant for the setup of a render queue pass that draws the counted
+    // surfaces again with program, after they have been drawn normally
+    void beginCount(Level level, Shader &program)
+    {
+        if (counting >= 0)
+            glEndQuery(GL_SAMPLES_PASSED);
+        else
+        {
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            // the same geometry drawn again lands on exactly the same depth
+            glDepthFunc(GL_LEQUAL);
+        }
+        program.setInt("materialLodCount"_uniform, level);
+        glBeginQuery(GL_SAMPLES_PASSED, queries[level]);
+        counting = level;
+    }
+
+    // ends the last count of the frame and restores the state the counting passes changed
+    void endCount(Shader &program)
+    {
+        if (counting < 0)
+            return;
+        glEndQuery(GL_SAMPLES_PASSED);
+        program.use();
+        program.setInt("materialLodCount"_uniform, -1);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        counting = -1;
+        pending = true;
+    }
+
+    void release()
+    {
+        if (queries[0] != 0)
+            glDeleteQueries(LEVELS, queries);
+        queries[0] = 0;
+    }
+
+    void printStats() const
+    {
+        if (counts == 0)
+            return;
+        unsigned long long total = 0;
+        for (unsigned long long fragments : totals)
+            total += fragments;
+        static const char *names[LEVELS] = {"parallax", "normal mapping", "flat"};
+        std::cout << "MaterialLod: parallax wall fragments per counted frame by level";
+        for (unsigned int level = 0; level < LEVELS; level++)
+            std::cout << (level == 0 ? " " : ", ") << names[level] << " " << totals[level] / counts << " ("
+                      << (total > 0 ? 100.0 * totals[level] / total : 0.0) << "%)";
+        std::cout << ", " << counts << " frames counted" << std::endl;
+    }
+
+private:
+    unsigned int queries[LEVELS] = {};
+    unsigned long long totals[LEVELS] = {};
+    unsigned long long counts = 0;
+    unsigned long long frame = 0;
+    int counting = -1;
+    bool pending = false;
+
+    void collect()
+    {
+        pending = false;
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[LEVELS - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        for (unsigned int level = 0; level < LEVELS; level++)
+        {
+            GLuint fragments = 0;
+            glGetQueryObjectuiv(queries[level], GL_QUERY_RESULT, &fragments);
+            totals[level] += fragments;
+        }
+        counts++;
+    }
+};
+
+#endif
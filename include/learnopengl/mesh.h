@@ -6,8 +6,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include <learnopengl/shader_m.h>
 
+#include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,7 +27,159 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// axis aligned box and bounding sphere of a vertex set
+struct Bounds {
+    glm::vec3 Min = glm::vec3(0.0f);
+    glm::vec3 Max = glm::vec3(0.0f);
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
 
+    static Bounds fromPositions(const Vertex *vertexData, size_t vertexCount)
+    {
+        Bounds bounds;
+        if (vertexCount == 0)
+            return bounds;
+        bounds.Min = bounds.Max = vertexData[0].Position;
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            bounds.Min = glm::min(bounds.Min, vertexData[i].Position);
+            bounds.Max = glm::max(bounds.Max, vertexData[i].Position);
+        }
+        // the sphere is centred on the box but only as large as the farthest vertex, which is tighter than half the diagonal
+        bounds.Center = 0.5f * (bounds.Min + bounds.Max);
+        float radius2 = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            glm::vec3 offset = vertexData[i].Position - bounds.Center;
+            radius2 = glm::max(radius2, glm::dot(offset, offset));
+        }
+        bounds.Radius = glm::sqrt(radius2);
+        return bounds;
+    }
+
+    // grows the box and sphere to contain other
+    void merge(const Bounds &other)
+    {
+        Min = glm::min(Min, other.Min);
+        Max = glm::max(Max, other.Max);
+        glm::vec3 center = 0.5f * (Min + Max);
+        Radius = glm::max(glm::length(Center - center) + Radius, glm::length(other.Center - center) + other.Radius);
+        Center = center;
+    }
+
+    // the axis aligned box around the transformed box (Arvo's method); the sphere scales with the largest axis
+    Bounds transformed(const glm::mat4 &transform) const
+    {
+        Bounds result;
+        glm::vec3 translation(transform[3]);
+        result.Min = result.Max = translation;
+        for (int column = 0; column < 3; column++)
+        {
+            glm::vec3 axis(transform[column]);
+            glm::vec3 a = axis * Min[column];
+            glm::vec3 b = axis * Max[column];
+            result.Min += glm::min(a, b);
+            result.Max += glm::max(a, b);
+        }
+        float scale = glm::max(glm::length(glm::vec3(transform[0])),
+                               glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        result.Center = glm::vec3(transform * glm::vec4(Center, 1.0f));
+        result.Radius = Radius * scale;
+        return result;
+    }
+};
+
+// the quantization of a model's positions for CompactVertex: positions are stored relative to Center in units of
+// Scale (the largest half extent of the model's bounds). The scale is the same on every axis, so the decode is a
+// similarity transform that can be folded into the model matrix without skewing normals.
+struct VertexQuantization {
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Scale = 1.0f;
+
+    static VertexQuantization fromBounds(const Bounds &bounds)
+    {
+        VertexQuantization quantization;
+        glm::vec3 halfExtent = 0.5f * (bounds.Max - bounds.Min);
+        quantization.Center = bounds.Center;
+        quantization.Scale = glm::max(glm::max(halfExtent.x, halfExtent.y), glm::max(halfExtent.z, 1e-6f));
+        return quantization;
+    }
+
+    // maps the decoded [-1, 1] positions back to object space
+    glm::mat4 decodeTransform() const
+    {
+        return glm::scale(glm::translate(glm::mat4(1.0f), Center), glm::vec3(Scale));
+    }
+};
+
+// 20 byte alternative to the 56 byte Vertex, decoded by normalMappingShader.vs when compactVertices is set
+struct CompactVertex {
+    int16_t Position[4]; // snorm16 xyz, see VertexQuantization; w is the bitangent sign (+-1)
+    uint32_t Normal;     // octahedral, 2 x snorm16
+    uint32_t Tangent;    // octahedral, 2 x snorm16
+    uint32_t TexCoords;  // 2 x half float
+
+    static CompactVertex encode(const Vertex &vertex, const VertexQuantization &quantization)
+    {
+        CompactVertex compact;
+        glm::vec3 position = (vertex.Position - quantization.Center) / quantization.Scale;
+        for (int i = 0; i < 3; i++)
+            compact.Position[i] = (int16_t)std::lround(glm::clamp(position[i], -1.0f, 1.0f) * 32767.0f);
+        // the bitangent is rebuilt as cross(normal, tangent) * sign
+        bool rightHanded = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+        compact.Position[3] = rightHanded ? 32767 : -32767;
+        compact.Normal = glm::packSnorm2x16(octahedral(vertex.Normal));
+        compact.Tangent = glm::packSnorm2x16(octahedral(vertex.Tangent));
+        compact.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+        return compact;
+    }
+
+    // projects a direction onto the octahedron |x| + |y| + |z| = 1 and unfolds the lower half over the corners
+    static glm::vec2 octahedral(glm::vec3 direction)
+    {
+        float sum = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f);
+        direction /= sum;
+        glm::vec2 encoded(direction.x, direction.y);
+        if (direction.z < 0.0f)
+            encoded = glm::vec2((1.0f - std::fabs(direction.y)) * (direction.x >= 0.0f ? 1.0f : -1.0f),
+                                (1.0f - std::fabs(direction.x)) * (direction.y >= 0.0f ? 1.0f : -1.0f));
+        return encoded;
+    }
+};
+static_assert(sizeof(CompactVertex) == 20, "CompactVertex must stay tightly packed");
+
+// per instance data of instanced draws; the vertex shaders read the transform at locations 5-8 (one per column)
+// and the tint at location 9
+struct Instance {
+    glm::mat4 Transform;
+    glm::vec4 Tint = glm::vec4(1.0f);
+};
+
+// points the instance attributes of the bound VAO at instanceVBO, starting at instance firstInstance
+inline void setupInstanceAttributes(unsigned int instanceVBO, size_t firstInstance)
+{
+    size_t base = firstInstance * sizeof(Instance);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(5 + column);
+        glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, Transform) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + column, 1);
+    }
+    glEnableVertexAttribArray(9);
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(base + offsetof(Instance, Tint)));
+    glVertexAttribDivisor(9, 1);
+}
+
+// one level of detail of a mesh: a range of its index buffer over the shared vertices, and the object space
+// distance by which the simplification may have moved the surface
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
 
 struct Texture {
     unsigned int id;
@@ -39,31 +193,111 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    // the ranges of indices (and of the index buffer) that make up each level of detail; lods[0] is the full mesh
+    vector<MeshLod>      lods;
 
     unsigned int VAO;
+    unsigned int indexCount; // of the full resolution level
+    // GL_UNSIGNED_SHORT for meshes with fewer than 65536 vertices, GL_UNSIGNED_INT otherwise
+    unsigned int indexType;
+    unsigned int vertexCount;
+    // the vertex buffer holds CompactVertex instead of Vertex
+    bool compact = false;
+    // object space bounds, for culling
+    Bounds bounds;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; with a quantization the vertices are uploaded as CompactVertex. Without lods all indices form
+    // a single level.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const VertexQuantization *quantization = nullptr,
+         vector<MeshLod> lods = vector<MeshLod>())
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->lods = lods;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), quantization);
+    }
+
+    // constructor for data that doesn't need to stay on the CPU (e.g. a memory-mapped mesh cache):
+    // the arrays are uploaded straight into the GL buffers and the vertices/indices vectors stay empty.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures,
+         const VertexQuantization *quantization = nullptr, vector<MeshLod> lods = vector<MeshLod>())
+    {
+        this->textures = textures;
+        this->lods = lods;
+        setupMesh(vertexData, vertexCount, indexData, indexCount, quantization);
+    }
+
+    // size of the vertex buffer on the GPU
+    size_t vertexBytes() const
+    {
+        return vertexCount * (compact ? sizeof(CompactVertex) : sizeof(Vertex));
     }
 
     // render the mesh
     void Draw(Shader &shader)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+        glBindVertexArray(0);
+
+        // always good
+        // practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render instanceCount copies of the mesh, reading their Instance data from instanceVBO starting at
+    // firstInstance. The shader's "instanced" uniform must be set so it takes the instance transform.
+    void DrawInstanced(Shader &shader, unsigned int instanceVBO, size_t firstInstance, size_t instanceCount)
+    {
+        bindTextures(shader);
+
+        glBindVertexArray(VAO);
+        setupInstanceAttributes(instanceVBO, firstInstance);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, instanceCount);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    // render data
+    unsigned int VBO, EBO;
+    // sampler uniform of every texture, e.g. "material.texture_diffuse1"; built on the first Draw since the
+    // prefix is set after construction
+    vector<UniformID> samplerUniforms;
+    std::string samplerUniformsPrefix;
+
+    void bindTextures(Shader &shader)
     {
         // bind appropriate textures
+        if (samplerUniforms.size() != textures.size() || samplerUniformsPrefix != glslIdentifierPrefix)
+            buildSamplerUniforms();
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit
+            shader.setInt(samplerUniforms[i], i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    void buildSamplerUniforms()
+    {
+        samplerUniforms.clear();
+        samplerUniformsPrefix = glslIdentifierPrefix;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,32 +309,21 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerUniforms.push_back(UniformID((glslIdentifierPrefix + name + number).c_str()));
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good
-        // practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+                   const VertexQuantization *quantization)
     {
+        if (lods.empty())
+            lods.push_back(MeshLod{0, (unsigned int)indexCount, 0.0f});
+        this->indexCount = lods[0].indexCount;
+        this->vertexCount = vertexCount;
+        bounds = Bounds::fromPositions(vertexData, vertexCount);
+        compact = quantization != nullptr;
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -109,13 +332,45 @@ private:
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        if (compact)
+        {
+            vector<CompactVertex> packed(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++)
+                packed[i] = CompactVertex::encode(vertexData[i], *quantization);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(CompactVertex), packed.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+        }
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        indexType = vertexCount < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            vector<uint16_t> narrowIndices(indexData, indexData + indexCount);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t), narrowIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+
+        if (compact)
+        {
+            // same locations as below, the shader tells the formats apart by its compactVertices uniform
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords));
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Tangent));
+            glBindVertexArray(0);
+            return;
+        }
 
         // set the vertex attribute pointers
         // vertex Positions
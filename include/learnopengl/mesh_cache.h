@@ -0,0 +1,303 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary cache of the final Vertex/index arrays of a Model, stored next to the source asset as <asset>.meshcache.
+// A warm start maps the file and hands the arrays straight to glBufferData, so Assimp isn't involved at all.
+// The cache records the size and modification time of the source file and every material library it references,
+// and is rejected as soon as one of them changes (or the format version/Vertex layout doesn't match).
+//
+// layout (all integers little endian, every section padded to 4 bytes):
+//   Header
+//   dependencyCount x { int64 size, int64 mtime, string path }
+//   meshCount x { uint32 vertexCount, uint32 indexCount, uint32 textureCount, uint32 lodCount,
+//                 textureCount x { string type, string path }, MeshLod[lodCount], Vertex[vertexCount], uint32[indexCount] }
+// where string is { uint32 length, char[length], padding }
+class MeshCache
+{
+public:
+    // 2: meshes are stored after MeshOptimizer (welded, cache/overdraw ordered, remapped)
+    // 3: levels of detail
+    static const uint32_t VERSION = 3;
+
+    struct Entry
+    {
+        const Vertex *vertices;
+        uint32_t vertexCount;
+        const unsigned int *indices;
+        uint32_t indexCount; // of all levels of detail together
+        vector<MeshLod> lods;
+        // (type, path) pairs in the order the textures were bound on the original mesh
+        vector<pair<string, string>> textures;
+    };
+
+    explicit MeshCache(const string &sourcePath) : sourcePath(sourcePath)
+    {
+    }
+
+    ~MeshCache()
+    {
+        if (mapping)
+            munmap(mapping, mappingSize);
+    }
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    static string cachePathFor(const string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache file and validates it against the source asset. Returns false if the model has to be imported again.
+    bool open()
+    {
+        string path = cachePathFor(sourcePath);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        mappingSize = info.st_size;
+        void *address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED)
+            return false;
+        mapping = address;
+
+        if (!parse())
+        {
+            entries.clear();
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    // valid after a successful open(); the arrays point into the mapping and live as long as this object
+    const vector<Entry> &getEntries() const
+    {
+        return entries;
+    }
+
+    // writes the cache for meshes that still have their vertices/indices on the CPU
+    static bool write(const string &sourcePath, const vector<Mesh> &meshes)
+    {
+        string path = cachePathFor(sourcePath);
+        string temporaryPath = path + ".tmp";
+        ofstream out(temporaryPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        vector<string> dependencies = findDependencies(sourcePath);
+        Header header;
+        memcpy(header.magic, magic(), sizeof(header.magic));
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.dependencyCount = dependencies.size();
+        header.meshCount = meshes.size();
+        out.write((const char *)&header, sizeof(header));
+
+        for (const string &dependency : dependencies)
+        {
+            FileStamp stamp = stampOf(dependency);
+            out.write((const char *)&stamp, sizeof(stamp));
+            writeString(out, dependency);
+        }
+
+        for (const Mesh &mesh : meshes)
+        {
+            uint32_t counts[4] = {(uint32_t)mesh.vertices.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.textures.size(),
+                                  (uint32_t)mesh.lods.size()};
+            out.write((const char *)counts, sizeof(counts));
+            for (const Texture &texture : mesh.textures)
+            {
+                writeString(out, texture.type);
+                writeString(out, texture.path);
+            }
+            out.write((const char *)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            out.write((const char *)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            out.write((const char *)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        }
+
+        out.close();
+        if (!out)
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static const char *magic()
+    {
+        return "RGMESHC";
+    }
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t dependencyCount;
+        uint32_t meshCount;
+    };
+
+    struct FileStamp
+    {
+        int64_t size;   // -1 if the file didn't exist
+        int64_t mtime;
+    };
+
+    string sourcePath;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t cursor = 0;
+    vector<Entry> entries;
+
+    // the asset itself plus, for Wavefront files, every material library it names
+    static vector<string> findDependencies(const string &sourcePath)
+    {
+        vector<string> dependencies;
+        dependencies.push_back(sourcePath);
+        string extension = sourcePath.substr(sourcePath.find_last_of('.') + 1);
+        if (extension == "obj" || extension == "OBJ")
+        {
+            string directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+            ifstream in(sourcePath);
+            string line;
+            while (getline(in, line))
+            {
+                if (line.compare(0, 7, "mtllib ") != 0)
+                    continue;
+                string library = line.substr(7);
+                while (!library.empty() && (library.back() == '\r' || library.back() == ' '))
+                    library.pop_back();
+                dependencies.push_back(directory + '/' + library);
+            }
+        }
+        return dependencies;
+    }
+
+    static FileStamp stampOf(const string &path)
+    {
+        FileStamp stamp = {-1, 0};
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0)
+        {
+            stamp.size = info.st_size;
+            stamp.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        }
+        return stamp;
+    }
+
+    static void writeString(ofstream &out, const string &value)
+    {
+        uint32_t length = value.size();
+        out.write((const char *)&length, sizeof(length));
+        out.write(value.data(), length);
+        static const char padding[4] = {0, 0, 0, 0};
+        out.write(padding, (4 - length % 4) % 4);
+    }
+
+    // returns a pointer to the next size bytes of the mapping, or nullptr if the file is truncated
+    const char *take(size_t size)
+    {
+        if (cursor + size > mappingSize)
+            return nullptr;
+        const char *pointer = (const char *)mapping + cursor;
+        cursor += size;
+        return pointer;
+    }
+
+    template <typename T>
+    bool takeValue(T &value)
+    {
+        const char *pointer = take(sizeof(T));
+        if (!pointer)
+            return false;
+        memcpy(&value, pointer, sizeof(T));
+        return true;
+    }
+
+    bool takeString(string &value)
+    {
+        uint32_t length;
+        if (!takeValue(length))
+            return false;
+        const char *pointer = take(length + (4 - length % 4) % 4);
+        if (!pointer)
+            return false;
+        value.assign(pointer, length);
+        return true;
+    }
+
+    bool parse()
+    {
+        cursor = 0;
+        Header header;
+        if (!takeValue(header) || memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.vertexSize != sizeof(Vertex))
+            return false;
+
+        for (uint32_t i = 0; i < header.dependencyCount; i++)
+        {
+            FileStamp stored;
+            string dependency;
+            if (!takeValue(stored) || !takeString(dependency))
+                return false;
+            FileStamp current = stampOf(dependency);
+            if (current.size != stored.size || current.mtime != stored.mtime)
+                return false;
+        }
+
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            uint32_t counts[4];
+            if (!takeValue(counts))
+                return false;
+            Entry entry;
+            entry.vertexCount = counts[0];
+            entry.indexCount = counts[1];
+            for (uint32_t t = 0; t < counts[2]; t++)
+            {
+                string type, path;
+                if (!takeString(type) || !takeString(path))
+                    return false;
+                entry.textures.push_back(make_pair(type, path));
+            }
+            const MeshLod *lods = (const MeshLod *)take(counts[3] * sizeof(MeshLod));
+            if (!lods)
+                return false;
+            entry.lods.assign(lods, lods + counts[3]);
+            entry.vertices = (const Vertex *)take(entry.vertexCount * sizeof(Vertex));
+            entry.indices = (const unsigned int *)take(entry.indexCount * sizeof(unsigned int));
+            if (!entry.vertices || !entry.indices)
+                return false;
+            entries.push_back(entry);
+        }
+        return true;
+    }
+};
+
+#endif
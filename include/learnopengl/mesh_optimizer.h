@@ -0,0 +1,497 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Import time optimization of an indexed triangle list, in this order:
+//
+//   1. weld bitwise identical vertices (ASSIMP without aiProcess_JoinIdenticalVertices emits one per corner)
+//   2. reorder the triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007)
+//   3. reorder the clusters Tipsify produced so outward facing ones come first, which reduces overdraw from any
+//      view without destroying the cache order within a cluster
+//   4. renumber the vertices in the order the indices first use them, so vertex fetch walks the buffer linearly
+//
+// The result is what ends up in the mesh cache, so it runs once per import. Cache efficiency is reported as ACMR
+// (vertex shader invocations per triangle) and ATVR (invocations per unique vertex, 1.0 is ideal) of a FIFO cache.
+//
+// buildLods() then derives coarser levels of detail by quadric error edge collapse (Garland and Heckbert). Edges
+// only ever collapse onto one of their vertices, so every level indexes the same vertex buffer as the base mesh.
+class MeshOptimizer
+{
+public:
+    // size of the simulated FIFO cache; small enough to hold on any GPU
+    static const unsigned int CACHE_SIZE = 16;
+    // levels of detail per mesh, including the full resolution one
+    static const unsigned int LOD_LEVELS = 4;
+
+    struct CacheStats
+    {
+        float acmr = 0.0f;
+        float atvr = 0.0f;
+    };
+
+    static CacheStats analyze(const vector<unsigned int> &indices, size_t vertexCount)
+    {
+        CacheStats stats;
+        if (indices.empty() || vertexCount == 0)
+            return stats;
+        // a vertex is in the FIFO if it was pushed less than CACHE_SIZE misses ago
+        vector<unsigned int> pushedAt(vertexCount, 0);
+        unsigned int time = CACHE_SIZE + 1;
+        unsigned int misses = 0;
+        for (unsigned int index : indices)
+        {
+            if (time - pushedAt[index] > CACHE_SIZE)
+            {
+                pushedAt[index] = time++;
+                misses++;
+            }
+        }
+        stats.acmr = (float)misses / (indices.size() / 3);
+        stats.atvr = (float)misses / vertexCount;
+        return stats;
+    }
+
+    static void optimize(vector<Vertex> &vertices, vector<unsigned int> &indices, const std::string &name)
+    {
+        size_t originalVertexCount = vertices.size();
+        CacheStats before = analyze(indices, vertices.size());
+
+        weld(vertices, indices);
+        vector<unsigned int> clusters;
+        indices = tipsify(indices, vertices.size(), clusters);
+        indices = sortClusters(vertices, indices, clusters);
+        remapForFetch(vertices, indices);
+
+        CacheStats after = analyze(indices, vertices.size());
+        std::cout << std::fixed << std::setprecision(3) << "MeshOptimizer: " << name << " " << indices.size() / 3
+                  << " triangles, " << originalVertexCount << " -> " << vertices.size() << " vertices, ACMR "
+                  << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << ", "
+                  << clusters.size() << " overdraw clusters, " << (vertices.size() < 65536 ? 16 : 32) << " bit indices"
+                  << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+
+    // merges bitwise identical vertices and drops the ones no index refers to any more
+    static void weld(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        std::unordered_map<std::string, unsigned int> vertexIndex;
+        vector<unsigned int> remap(vertices.size());
+        vector<Vertex> welded;
+        welded.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            std::string key((const char *)&vertices[i], sizeof(Vertex));
+            auto found = vertexIndex.find(key);
+            if (found != vertexIndex.end())
+            {
+                remap[i] = found->second;
+                continue;
+            }
+            remap[i] = welded.size();
+            vertexIndex[key] = welded.size();
+            welded.push_back(vertices[i]);
+        }
+        for (unsigned int &index : indices)
+            index = remap[index];
+        vertices.swap(welded);
+    }
+
+    // Tipsify: fans around the most recently used vertex that still has triangles left, preferring vertices that
+    // will still be in the cache once their remaining triangles are emitted. clusterStarts receives the triangle at
+    // which each cluster begins, i.e. where the walk had to jump because no cached vertex had triangles left.
+    static vector<unsigned int> tipsify(const vector<unsigned int> &indices, size_t vertexCount, vector<unsigned int> &clusterStarts)
+    {
+        size_t triangleCount = indices.size() / 3;
+        // triangles around every vertex, as offsets into one array
+        vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+        vector<unsigned int> adjacency(indices.size());
+        vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        vector<unsigned int> cacheTime(vertexCount, 0);
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> deadEnd;
+        vector<unsigned int> candidates;
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        clusterStarts.clear();
+
+        unsigned int time = CACHE_SIZE + 1;
+        size_t cursor = 0;
+        int fanning = vertexCount > 0 ? 0 : -1;
+        bool jumped = true;
+        while (fanning >= 0)
+        {
+            if (jumped && (clusterStarts.empty() || clusterStarts.back() != result.size() / 3))
+                clusterStarts.push_back(result.size() / 3);
+            candidates.clear();
+            for (unsigned int a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+            {
+                unsigned int triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = true;
+                for (unsigned int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int v = indices[triangle * 3 + corner];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > CACHE_SIZE)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // the candidate that is oldest in the cache while still surviving its own remaining triangles
+            fanning = -1;
+            int bestPriority = -1;
+            for (unsigned int v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= CACHE_SIZE)
+                    priority = time - cacheTime[v];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    fanning = v;
+                }
+            }
+            jumped = fanning < 0;
+            if (jumped)
+                fanning = skipDeadEnd(liveTriangles, deadEnd, cursor);
+        }
+        return result;
+    }
+
+    // LOD_LEVELS index lists concatenated: level 0 is indices itself, every further one aims at half the triangles of
+    // the level before, simplified from it and ordered for the vertex cache. A level that can't be simplified
+    // noticeably further (border and seam vertices are never removed) repeats the range of the previous one.
+    static vector<unsigned int> buildLods(const vector<Vertex> &vertices, const vector<unsigned int> &indices, vector<MeshLod> &lods)
+    {
+        vector<unsigned int> levels(indices);
+        lods.assign(1, MeshLod{0, (unsigned int)indices.size(), 0.0f});
+        vector<unsigned int> current(indices);
+        float error = 0.0f;
+        for (unsigned int level = 1; level < LOD_LEVELS; level++)
+        {
+            vector<unsigned int> simplified = simplify(vertices, current, current.size() / 6 * 3, error);
+            if (simplified.empty() || simplified.size() * 10 > current.size() * 9)
+            {
+                lods.push_back(lods.back());
+                continue;
+            }
+            vector<unsigned int> clusters;
+            simplified = tipsify(simplified, vertices.size(), clusters);
+            lods.push_back(MeshLod{(unsigned int)levels.size(), (unsigned int)simplified.size(), error});
+            levels.insert(levels.end(), simplified.begin(), simplified.end());
+            current.swap(simplified);
+        }
+        return levels;
+    }
+
+    // collapses the cheapest edges until at most targetIndexCount indices are left or nothing can collapse any more.
+    // error grows to the square root of the largest cost accepted, a distance in object space.
+    static vector<unsigned int> simplify(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                                         size_t targetIndexCount, float &error)
+    {
+        size_t vertexCount = vertices.size();
+        size_t triangleCount = indices.size() / 3;
+        vector<unsigned int> triangles(indices);
+        vector<bool> removed(triangleCount, false);
+        size_t liveTriangles = triangleCount;
+
+        vector<Quadric> quadrics(vertexCount);
+        vector<vector<unsigned int>> vertexTriangles(vertexCount);
+        std::unordered_map<uint64_t, unsigned int> edgeUses;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3 &p0 = vertices[triangles[t * 3]].Position;
+            glm::vec3 normal = glm::cross(vertices[triangles[t * 3 + 1]].Position - p0, vertices[triangles[t * 3 + 2]].Position - p0);
+            float area = glm::length(normal);
+            for (unsigned int corner = 0; corner < 3; corner++)
+            {
+                unsigned int a = triangles[t * 3 + corner], b = triangles[t * 3 + (corner + 1) % 3];
+                vertexTriangles[a].push_back(t);
+                if (area > 0.0f)
+                    quadrics[a].addPlane(normal / area, -glm::dot(normal / area, p0), area);
+                edgeUses[edgeKey(a, b)]++;
+            }
+        }
+        // edges of a single triangle are borders, in index space that includes texture and normal seams
+        vector<bool> locked(vertexCount, false);
+        for (const auto &edge : edgeUses)
+            if (edge.second == 1)
+            {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFFu] = true;
+            }
+
+        vector<unsigned int> version(vertexCount, 0);
+        std::priority_queue<Collapse> queue;
+        auto push = [&](unsigned int from, unsigned int to) {
+            if (locked[from])
+                return;
+            Quadric combined = quadrics[from];
+            combined.add(quadrics[to]);
+            // the area weighted mean of the squared distances, so costs compare across triangle sizes
+            double cost = combined.evaluate(vertices[to].Position) / std::max(combined.weight, 1e-12);
+            queue.push(Collapse{cost, from, to, version[from], version[to]});
+        };
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            size_t next = i - i % 3 + (i + 1) % 3;
+            push(triangles[i], triangles[next]);
+            push(triangles[next], triangles[i]);
+        }
+
+        while (liveTriangles * 3 > targetIndexCount && !queue.empty())
+        {
+            Collapse collapse = queue.top();
+            queue.pop();
+            if (collapse.fromVersion != version[collapse.from] || collapse.toVersion != version[collapse.to])
+                continue;
+            if (flips(vertices, triangles, removed, vertexTriangles[collapse.from], collapse.from, collapse.to))
+                continue;
+
+            for (unsigned int t : vertexTriangles[collapse.from])
+            {
+                if (removed[t])
+                    continue;
+                unsigned int *corners = &triangles[t * 3];
+                if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to)
+                {
+                    removed[t] = true;
+                    liveTriangles--;
+                    continue;
+                }
+                for (unsigned int corner = 0; corner < 3; corner++)
+                    if (corners[corner] == collapse.from)
+                        corners[corner] = collapse.to;
+                vertexTriangles[collapse.to].push_back(t);
+            }
+            vector<unsigned int>().swap(vertexTriangles[collapse.from]);
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            version[collapse.from]++;
+            version[collapse.to]++;
+            error = std::max(error, (float)std::sqrt(std::max(collapse.cost, 0.0)));
+
+            for (unsigned int t : vertexTriangles[collapse.to])
+            {
+                if (removed[t])
+                    continue;
+                for (unsigned int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int neighbour = triangles[t * 3 + corner];
+                    if (neighbour == collapse.to)
+                        continue;
+                    push(neighbour, collapse.to);
+                    push(collapse.to, neighbour);
+                }
+            }
+        }
+
+        vector<unsigned int> result;
+        result.reserve(liveTriangles * 3);
+        for (size_t t = 0; t < triangleCount; t++)
+            if (!removed[t])
+                result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        return result;
+    }
+
+private:
+    // symmetric 4x4 matrix summing the squared distances to a set of planes, upper triangle row by row, weighted by
+    // the area of the triangles the planes came from
+    struct Quadric
+    {
+        double m[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        double weight = 0.0;
+
+        void addPlane(const glm::vec3 &n, float d, float area)
+        {
+            const double p[4] = {n.x, n.y, n.z, d};
+            int k = 0;
+            for (int i = 0; i < 4; i++)
+                for (int j = i; j < 4; j++)
+                    m[k++] += area * p[i] * p[j];
+            weight += area;
+        }
+
+        void add(const Quadric &other)
+        {
+            for (int k = 0; k < 10; k++)
+                m[k] += other.m[k];
+            weight += other.weight;
+        }
+
+        double evaluate(const glm::vec3 &v) const
+        {
+            const double p[4] = {v.x, v.y, v.z, 1.0};
+            double sum = 0.0;
+            int k = 0;
+            for (int i = 0; i < 4; i++)
+                for (int j = i; j < 4; j++)
+                    sum += (i == j ? 1.0 : 2.0) * m[k++] * p[i] * p[j];
+            return sum;
+        }
+    };
+
+    // ordered by cost, cheapest first; entries are stale once either vertex changed
+    struct Collapse
+    {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromVersion, toVersion;
+
+        bool operator<(const Collapse &other) const
+        {
+            return cost > other.cost;
+        }
+    };
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+    }
+
+    // whether moving from onto to would turn one of the triangles (nearly) around or make it degenerate
+    static bool flips(const vector<Vertex> &vertices, const vector<unsigned int> &triangles, const vector<bool> &removed,
+                      const vector<unsigned int> &fromTriangles, unsigned int from, unsigned int to)
+    {
+        for (unsigned int t : fromTriangles)
+        {
+            if (removed[t])
+                continue;
+            const unsigned int *corners = &triangles[t * 3];
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+                continue;
+            glm::vec3 before[3], after[3];
+            for (unsigned int corner = 0; corner < 3; corner++)
+            {
+                before[corner] = vertices[corners[corner]].Position;
+                after[corner] = corners[corner] == from ? vertices[to].Position : before[corner];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            // more than ~75 degrees of rotation counts as a flip, so folds can't build up over several collapses
+            float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+            if (lengths == 0.0f || glm::dot(normalBefore, normalAfter) < 0.25f * lengths)
+                return true;
+        }
+        return false;
+    }
+
+    // the most recent vertex with triangles left, else the next one in input order
+    static int skipDeadEnd(const vector<unsigned int> &liveTriangles, vector<unsigned int> &deadEnd, size_t &cursor)
+    {
+        while (!deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+        for (; cursor < liveTriangles.size(); cursor++)
+            if (liveTriangles[cursor] > 0)
+                return cursor;
+        return -1;
+    }
+
+    // orders the clusters by how much they face away from the mesh centre (Sander et al.): those are the ones that
+    // can occlude the rest, so drawing them first lets the depth test reject more of what follows
+    static vector<unsigned int> sortClusters(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                                             const vector<unsigned int> &clusterStarts)
+    {
+        size_t triangleCount = indices.size() / 3;
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        vector<glm::vec3> clusterCentroids(clusterStarts.size(), glm::vec3(0.0f));
+        vector<glm::vec3> clusterNormals(clusterStarts.size(), glm::vec3(0.0f));
+        vector<float> clusterAreas(clusterStarts.size(), 0.0f);
+        for (size_t cluster = 0; cluster < clusterStarts.size(); cluster++)
+        {
+            size_t end = cluster + 1 < clusterStarts.size() ? clusterStarts[cluster + 1] : triangleCount;
+            for (size_t triangle = clusterStarts[cluster]; triangle < end; triangle++)
+            {
+                const glm::vec3 &p0 = vertices[indices[triangle * 3]].Position;
+                const glm::vec3 &p1 = vertices[indices[triangle * 3 + 1]].Position;
+                const glm::vec3 &p2 = vertices[indices[triangle * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+                clusterCentroids[cluster] += centroid * area;
+                clusterNormals[cluster] += normal;
+                clusterAreas[cluster] += area;
+                meshCentroid += centroid * area;
+                meshArea += area;
+            }
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        vector<float> sortKeys(clusterStarts.size(), 0.0f);
+        for (size_t cluster = 0; cluster < clusterStarts.size(); cluster++)
+        {
+            float normalLength = glm::length(clusterNormals[cluster]);
+            if (clusterAreas[cluster] > 0.0f && normalLength > 0.0f)
+                sortKeys[cluster] = glm::dot(clusterCentroids[cluster] / clusterAreas[cluster] - meshCentroid,
+                                             clusterNormals[cluster] / normalLength);
+        }
+        vector<unsigned int> order(clusterStarts.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (unsigned int cluster : order)
+        {
+            size_t end = cluster + 1 < clusterStarts.size() ? clusterStarts[cluster + 1] : triangleCount;
+            result.insert(result.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + end * 3);
+        }
+        return result;
+    }
+
+    // renumbers the vertices in order of first use
+    static void remapForFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        const unsigned int UNUSED = 0xFFFFFFFFu;
+        vector<unsigned int> remap(vertices.size(), UNUSED);
+        vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+};
+
+#endif
@@ -11,17 +11,30 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
-#include <learnopengl/shader.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/texture_registry.h>
 
+#include <chrono>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, TextureUsage usage = TextureUsage::Color);
+
+// Full uploads Vertex as is; Compact uploads CompactVertex (normalMappingShader only), quantized against the bounds
+// of the whole model so that all its meshes share VertexTransform
+enum class VertexFormat {
+    Full,
+    Compact
+};
 
 
 
@@ -30,21 +43,68 @@ class Model
 public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    unordered_map<string, unsigned int> textures_loaded_index;	// path -> index into textures_loaded
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat format;
+    // maps the vertex positions as stored on the GPU to object space: identity for Full, the dequantization for
+    // Compact. Model matrices of compact models have to be multiplied by it (Draw and DrawInstanced don't).
+    glm::mat4 VertexTransform = glm::mat4(1.0f);
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, VertexFormat format = VertexFormat::Full) : gammaCorrection(gamma), format(format)
     {
         loadModel(path);
     }
 
+    // object space bounds of all meshes together
+    Bounds GetBounds() const
+    {
+        if (meshes.empty())
+            return Bounds();
+        Bounds bounds = meshes[0].bounds;
+        for (size_t i = 1; i < meshes.size(); i++)
+            bounds.merge(meshes[i].bounds);
+        return bounds;
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        shader.setBool("compactVertices"_uniform, format == VertexFormat::Compact);
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
+        shader.setBool("compactVertices"_uniform, false);
+    }
+
+    // draws one copy of the model per instance with a single instanced draw per mesh, however many instances there are
+    void DrawInstanced(Shader &shader, const vector<Instance> &instances)
+    {
+        if (instances.empty())
+            return;
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+
+        shader.setBool("instanced"_uniform, true);
+        shader.setBool("compactVertices"_uniform, format == VertexFormat::Compact);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instanceVBO, 0, instances.size());
+        shader.setBool("instanced"_uniform, false);
+        shader.setBool("compactVertices"_uniform, false);
+    }
+
+    // hands the model's textures back to the TextureRegistry and frees the instance buffer; call while the GL context is still current
+    void ReleaseTextures()
+    {
+        for (const Texture &texture : textures_loaded)
+            TextureRegistry::instance().release(texture.id);
+        textures_loaded.clear();
+        textures_loaded_index.clear();
+        glDeleteBuffers(1, &instanceVBO);
+        instanceVBO = 0;
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
@@ -53,23 +113,120 @@ public:
         }
     }
 private:
+    // per instance data of the last DrawInstanced, created on first use
+    unsigned int instanceVBO = 0;
+    VertexQuantization quantization;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // a valid <path>.meshcache next to the model is used instead of ASSIMP; otherwise the cache is (re)written after the import.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
-        }
+        auto start = std::chrono::steady_clock::now();
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        bool warm = loadFromCache(path);
+        if (!warm)
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+
+            if (format == VertexFormat::Compact)
+            {
+                Bounds bounds;
+                bool first = true;
+                for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+                {
+                    const aiMesh *mesh = scene->mMeshes[i];
+                    if (mesh->mNumVertices == 0)
+                        continue;
+                    Bounds meshBounds;
+                    meshBounds.Min = meshBounds.Max = glm::vec3(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z);
+                    for (unsigned int j = 1; j < mesh->mNumVertices; j++)
+                    {
+                        glm::vec3 position(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
+                        meshBounds.Min = glm::min(meshBounds.Min, position);
+                        meshBounds.Max = glm::max(meshBounds.Max, position);
+                    }
+                    meshBounds.Center = 0.5f * (meshBounds.Min + meshBounds.Max);
+                    if (first)
+                        bounds = meshBounds;
+                    else
+                        bounds.merge(meshBounds);
+                    first = false;
+                }
+                setQuantization(bounds);
+            }
+
+            // process ASSIMP's root node recursively
+            processNode(scene->mRootNode, scene);
+
+            if (!MeshCache::write(path, meshes))
+                cout << "WARNING::MODEL:: failed to write mesh cache " << MeshCache::cachePathFor(path) << endl;
+        }
+
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t vertexCount = 0, vertexBytes = 0;
+        for (const Mesh &mesh : meshes)
+        {
+            vertexCount += mesh.vertexCount;
+            vertexBytes += mesh.vertexBytes();
+        }
+        cout << "Model: " << path << " loaded in " << ms << " ms ("
+             << (warm ? "warm, from mesh cache" : "cold, imported with ASSIMP") << "), " << vertexCount << " vertices in "
+             << vertexBytes / 1024 << " KiB";
+        if (format == VertexFormat::Compact)
+            cout << " (compact, " << vertexCount * sizeof(Vertex) / 1024 << " KiB as Vertex)";
+        cout << endl;
+    }
+
+    // the quantization every mesh of a compact model is encoded with
+    void setQuantization(const Bounds &bounds)
+    {
+        quantization = VertexQuantization::fromBounds(bounds);
+        VertexTransform = quantization.decodeTransform();
+    }
+
+    const VertexQuantization *meshQuantization() const
+    {
+        return format == VertexFormat::Compact ? &quantization : nullptr;
+    }
+
+    // builds the meshes straight from a memory-mapped mesh cache. Returns false if there is no up to date cache.
+    bool loadFromCache(string const &path)
+    {
+        MeshCache cache(path);
+        if (!cache.open())
+            return false;
+        if (format == VertexFormat::Compact)
+        {
+            Bounds bounds;
+            for (size_t i = 0; i < cache.getEntries().size(); i++)
+            {
+                const MeshCache::Entry &entry = cache.getEntries()[i];
+                Bounds entryBounds = Bounds::fromPositions(entry.vertices, entry.vertexCount);
+                if (i == 0)
+                    bounds = entryBounds;
+                else
+                    bounds.merge(entryBounds);
+            }
+            setQuantization(bounds);
+        }
+        for (const MeshCache::Entry &entry : cache.getEntries())
+        {
+            vector<Texture> textures;
+            for (const pair<string, string> &texture : entry.textures)
+                textures.push_back(loadMaterialTexture(texture.second, texture.first));
+            meshes.push_back(Mesh(entry.vertices, entry.vertexCount, entry.indices, entry.indexCount, textures, meshQuantization(), entry.lods));
+        }
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -178,8 +335,14 @@ private:
 
 
 
+        // weld, reorder for the vertex cache and overdraw, remap for fetch; the mesh cache stores the result
+        MeshOptimizer::optimize(vertices, indices, directory + "/" + mesh->mName.C_Str());
+        // coarser levels of detail over the same vertices, appended to the indices
+        vector<MeshLod> lods;
+        indices = MeshOptimizer::buildLods(vertices, indices, lods);
+
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(vertices, indices, textures, meshQuantization(), lods);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -191,69 +354,44 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadMaterialTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // returns the texture with the given path relative to the model directory, loading it if it isn't loaded yet.
+    Texture loadMaterialTexture(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, return it: skip loading a new texture
+        auto loaded = textures_loaded_index.find(path);
+        if (loaded != textures_loaded_index.end())
+            return textures_loaded[loaded->second]; // a texture with the same filepath has already been loaded. (optimization)
+        // if texture hasn't been loaded already, load it
+        TextureUsage usage = TextureUsage::Color;
+        if (typeName == "texture_specular")
+            usage = TextureUsage::Specular;
+        else if (typeName == "texture_normal")
+            usage = TextureUsage::Normal;
+        else if (typeName == "texture_height")
+            usage = TextureUsage::Height;
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory, false, usage);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded_index[path] = textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// acquires the texture from the shared TextureRegistry (release it there when done). A texture that wasn't
+// resident yet is queued on the TextureLoader and has storage once TextureLoader::finish() ran.
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, TextureUsage usage)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().acquire(filename, usage);
 }
 #endif
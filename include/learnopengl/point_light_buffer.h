@@ -0,0 +1,105 @@
+#ifndef POINT_LIGHT_BUFFER_H
+#define POINT_LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// one point light as four RGBA32F texels of the pointLights texture buffer, see FetchPointLight in the shaders
+struct PointLightData
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+
+    // the distance at which the attenuated light drops below 5/256 of its brightest channel; shading ignores the
+    // light beyond it
+    static float rangeOf(const PointLightData &light)
+    {
+        glm::vec3 peak = glm::max(light.diffuse, light.specular);
+        float brightest = std::max(peak.x, std::max(peak.y, peak.z));
+        float c = light.constant - brightest * 256.0f / 5.0f;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (light.quadratic <= 0.0f)
+            return light.linear > 0.0f ? -c / light.linear : 1.0e4f;
+        return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+    }
+};
+static_assert(sizeof(PointLightData) == 64, "PointLightData must be four vec4 texels");
+
+// Every point light of the scene in a texture buffer, so a shader can loop over any number of them (a uniform
+// block tops out at 16 KiB). The buffer is bound to its own texture unit after the material units; like
+// LightUniformBuffer, update() only re-uploads it when the lights actually changed.
+class PointLightBuffer
+{
+public:
+    static const unsigned int TEXTURE_UNIT = 4;
+
+    PointLightBuffer()
+    {
+        glGenBuffers(1, &TBO);
+        glGenTextures(1, &texture);
+    }
+
+    // points the program's pointLights sampler at TEXTURE_UNIT
+    void attach(Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("pointLights"_uniform, TEXTURE_UNIT);
+    }
+
+    // returns whether the buffer had to be written
+    bool update(const std::vector<PointLightData> &lights)
+    {
+        if (lights.size() == uploaded.size() && std::memcmp(lights.data(), uploaded.data(), lights.size() * sizeof(PointLightData)) == 0)
+            return false;
+        uploaded = lights;
+        glBindBuffer(GL_TEXTURE_BUFFER, TBO);
+        // orphan the old storage rather than wait for draws still reading it; never empty, a texture buffer needs storage
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, lights.size()) * sizeof(PointLightData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, lights.size() * sizeof(PointLightData), lights.data());
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, TBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return true;
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    unsigned int count() const
+    {
+        return uploaded.size();
+    }
+
+    void release()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &TBO);
+        texture = TBO = 0;
+    }
+
+private:
+    unsigned int TBO = 0;
+    unsigned int texture = 0;
+    std::vector<PointLightData> uploaded;
+};
+
+#endif
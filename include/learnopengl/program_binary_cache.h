@@ -0,0 +1,185 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// glad is generated for core 3.3, which doesn't have program binaries (core since 4.1, GL_ARB_get_program_binary before)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// Caches linked shader programs with glGetProgramBinary/glProgramBinary, one file per program next to its vertex
+// shader (<vertex shader>.<fragment shader name>.programbinary, since programs may share a vertex shader). The
+// file is keyed by a hash of both sources and the driver's vendor, renderer and version strings; a key mismatch,
+// a missing file or a binary the driver rejects all mean the caller compiles from source as usual and stores the
+// fresh binary afterwards.
+class ProgramBinaryCache
+{
+public:
+    // returns a linked program from the cache, or 0 if the program has to be compiled
+    static unsigned int load(const std::string &cachePath, const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        if (!functions().supported)
+            return 0;
+        std::ifstream in(cachePath, std::ios::binary);
+        if (!in)
+            return 0;
+        Header header;
+        if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, "RGPROGB", 8) != 0 ||
+            header.key != keyFor(vertexCode, fragmentCode))
+            return 0;
+        std::vector<char> binary(header.length);
+        if (!in.read(binary.data(), binary.size()))
+            return 0;
+
+        unsigned int program = glCreateProgram();
+        functions().programBinary(program, header.format, binary.data(), binary.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // e.g. after a driver update that kept the version string; fall back to compiling
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // call before glLinkProgram so the driver keeps the binary around for store()
+    static void prepare(unsigned int program)
+    {
+        if (functions().supported)
+            functions().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a successfully linked program
+    static void store(const std::string &cachePath, const std::string &vertexCode, const std::string &fragmentCode, unsigned int program)
+    {
+        if (!functions().supported)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        Header header;
+        memcpy(header.magic, "RGPROGB", 8);
+        header.key = keyFor(vertexCode, fragmentCode);
+        functions().getProgramBinary(program, length, &length, &header.format, binary.data());
+        header.length = length;
+
+        const std::string &path = cachePath;
+        std::string temporaryPath = path + ".tmp";
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        out.write((const char *)&header, sizeof(header));
+        out.write(binary.data(), length);
+        out.close();
+        if (!out || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporaryPath.c_str());
+            std::cout << "WARNING::SHADER:: failed to write program binary " << path << std::endl;
+        }
+    }
+
+    static std::string cachePathFor(const std::string &vertexPath, const std::string &fragmentPath)
+    {
+        size_t slash = fragmentPath.find_last_of("/\\");
+        return vertexPath + "." + fragmentPath.substr(slash == std::string::npos ? 0 : slash + 1) + ".programbinary";
+    }
+
+private:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+    struct Functions
+    {
+        bool supported = false;
+        GetProgramBinaryProc getProgramBinary = nullptr;
+        ProgramBinaryProc programBinary = nullptr;
+        ProgramParameteriProc programParameteri = nullptr;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    // resolved on first use, on the thread that owns the context
+    static const Functions &functions()
+    {
+        static Functions loaded = loadFunctions();
+        return loaded;
+    }
+
+    static Functions loadFunctions()
+    {
+        Functions result;
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool available = major > 4 || (major == 4 && minor >= 1);
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count && !available; i++)
+        {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            available = extension && strcmp(extension, "GL_ARB_get_program_binary") == 0;
+        }
+        if (!available)
+            return result;
+
+        // a driver may support the API but not offer a single binary format
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        result.getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+        result.programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+        result.programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+        result.supported = formats > 0 && result.getProgramBinary && result.programBinary && result.programParameteri;
+        return result;
+    }
+
+    // 64 bit FNV-1a over both sources and the driver identification
+    static uint64_t keyFor(const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char *data, size_t size) {
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= (unsigned char)data[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xFF; // separator, so "ab"+"c" and "a"+"bc" differ
+            hash *= 1099511628211ull;
+        };
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char *value = (const char *)glGetString(name);
+            if (value)
+                mix(value, strlen(value));
+        }
+        return hash;
+    }
+};
+
+#endif
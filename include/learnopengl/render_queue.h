@@ -0,0 +1,369 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Collects the frame's draws and executes them sorted by a 64 bit key, so that draws sharing state end up next to
+// each other and only the state that actually differs from the previous draw is changed. From the most to the
+// least significant bits the key holds
+//
+//     pass (6) | program (6) | material (14) | VAO (14) | depth (24)
+//
+// Passes run in the order they were added and own the fixed function state and per pass uniforms (set up in a
+// callback). A material is a set of textures bound to consecutive texture units starting at GL_TEXTURE0; the
+// samplers of the programs are expected to point at those units. Within a material and VAO draws go front to back.
+//
+// Every draw is instanced: the transforms (and tints) of all items are gathered into one per frame instance buffer
+// that is uploaded once in execute(), so a prop repeated N times costs one draw rather than N.
+class RenderQueue
+{
+public:
+    static const unsigned int MAX_TEXTURES = 4;
+
+    struct Material
+    {
+        unsigned int textures[MAX_TEXTURES];
+    };
+
+    struct FrameStats
+    {
+        unsigned int draws = 0;
+        unsigned int instances = 0;
+        unsigned long long triangles = 0;
+        unsigned int passChanges = 0;
+        unsigned int programChanges = 0;
+        unsigned int textureBinds = 0;
+        unsigned int vaoBinds = 0;
+
+        unsigned int stateChanges() const
+        {
+            return passChanges + programChanges + textureBinds + vaoBinds;
+        }
+    };
+
+    // setup runs with the pass's first program bound, and again whenever the program changes inside the pass
+    unsigned int addPass(const std::string &name, std::function<void(Shader &)> setup)
+    {
+        passes.push_back(Pass{name, setup});
+        return passes.size() - 1;
+    }
+
+    // textures are bound to GL_TEXTURE0, GL_TEXTURE1, ... in the given order
+    unsigned int addMaterial(const std::vector<unsigned int> &textures)
+    {
+        Material material = {};
+        for (size_t unit = 0; unit < textures.size() && unit < MAX_TEXTURES; unit++)
+            material.textures[unit] = textures[unit];
+        materials.push_back(material);
+        return materials.size() - 1;
+    }
+
+    // starts a new frame; depth is measured from the camera position. Textures may have been bound outside the
+    // queue since the last frame (screen pass, texture streaming), so nothing is assumed to be bound any more.
+    void begin(const glm::vec3 &cameraPosition)
+    {
+        viewPosition = cameraPosition;
+        items.clear();
+        instances.clear();
+        std::fill(boundTextures, boundTextures + MAX_TEXTURES, 0u);
+    }
+
+    // an indexed draw of indexCount indices of indexType (GL_UNSIGNED_INT or GL_UNSIGNED_SHORT) starting at firstIndex,
+    // once per instance, as a single glDrawElementsInstanced
+    void submitInstanced(unsigned int pass, Shader &shader, unsigned int material, unsigned int VAO,
+                         unsigned int firstIndex, unsigned int indexCount, const std::vector<Instance> &drawInstances,
+                         unsigned int indexType = GL_UNSIGNED_INT)
+    {
+        submitInstanced(pass, shader, material, VAO, firstIndex, indexCount, drawInstances.data(), drawInstances.size(), indexType);
+    }
+
+    void submitInstanced(unsigned int pass, Shader &shader, unsigned int material, unsigned int VAO,
+                         unsigned int firstIndex, unsigned int indexCount, const Instance *drawInstances, size_t instanceCount,
+                         unsigned int indexType = GL_UNSIGNED_INT)
+    {
+        if (instanceCount == 0)
+            return;
+        Item item;
+        item.shader = &shader;
+        item.pass = pass;
+        item.material = material;
+        item.VAO = VAO;
+        item.firstIndex = firstIndex;
+        item.indexCount = indexCount;
+        item.indexType = indexType;
+        item.firstInstance = instances.size();
+        item.instanceCount = instanceCount;
+        instances.insert(instances.end(), drawInstances, drawInstances + instanceCount);
+
+        // 24 bit depth of the first instance: the bits of a positive float sort like the float itself; the sign
+        // bit is always clear
+        glm::vec3 offset = glm::vec3(drawInstances[0].Transform[3]) - viewPosition;
+        float distance = glm::dot(offset, offset);
+        uint32_t depthBits;
+        std::memcpy(&depthBits, &distance, sizeof(depthBits));
+        item.key = (uint64_t)(pass & 0x3F) << 58 | (uint64_t)(smallIndex(programs, shader.ID) & 0x3F) << 52 |
+                   (uint64_t)(material & 0x3FFF) << 38 | (uint64_t)(smallIndex(vertexArrays, VAO) & 0x3FFF) << 24 |
+                   (depthBits >> 7);
+        items.push_back(item);
+    }
+
+    // sorts and draws the frame's items, then leaves VAO 0 bound and GL_TEXTURE0 active
+    void execute()
+    {
+        submissionOrderStateChanges += simulate();
+        sortItems();
+        uploadInstances();
+
+        FrameStats frame;
+        int currentPass = -1;
+        Shader *currentShader = nullptr;
+        unsigned int currentVAO = 0;
+        int currentMaterial = -1;
+        for (const SortEntry &entry : order)
+        {
+            const Item &item = items[entry.index];
+            if ((int)item.pass != currentPass || item.shader != currentShader)
+            {
+                if ((int)item.pass != currentPass)
+                {
+                    if (currentPass >= 0)
+                        GpuProfiler::instance().end();
+                    GpuProfiler::instance().begin(passes[item.pass].name.c_str());
+                    frame.passChanges++;
+                }
+                if (item.shader != currentShader)
+                {
+                    item.shader->use();
+                    item.shader->setBool("instanced"_uniform, true);
+                    frame.programChanges++;
+                }
+                currentPass = item.pass;
+                currentShader = item.shader;
+                passes[item.pass].setup(*item.shader);
+            }
+            if ((int)item.material != currentMaterial)
+            {
+                for (unsigned int unit = 0; unit < MAX_TEXTURES; unit++)
+                {
+                    unsigned int texture = materials[item.material].textures[unit];
+                    if (texture == 0 || boundTextures[unit] == texture)
+                        continue;
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                    boundTextures[unit] = texture;
+                    frame.textureBinds++;
+                }
+                currentMaterial = item.material;
+            }
+            if (item.VAO != currentVAO)
+            {
+                glBindVertexArray(item.VAO);
+                currentVAO = item.VAO;
+                frame.vaoBinds++;
+            }
+            // the instance attributes are part of the VAO state, so they are re-pointed for every item
+            setupInstanceAttributes(instanceVBO, item.firstInstance);
+            size_t indexSize = item.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            glDrawElementsInstanced(GL_TRIANGLES, item.indexCount, item.indexType,
+                                    (void*)(item.firstIndex * indexSize), item.instanceCount);
+            frame.draws++;
+            frame.instances += item.instanceCount;
+            frame.triangles += (unsigned long long)(item.indexCount / 3) * item.instanceCount;
+        }
+        if (currentPass >= 0)
+            GpuProfiler::instance().end();
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        // the programs are also drawn outside the queue, with their model uniform
+        std::vector<Shader *> restored;
+        for (const Item &item : items)
+            if (std::find(restored.begin(), restored.end(), item.shader) == restored.end())
+            {
+                item.shader->use();
+                item.shader->setBool("instanced"_uniform, false);
+                restored.push_back(item.shader);
+            }
+
+        lastFrame = frame;
+        totals.draws += frame.draws;
+        totals.instances += frame.instances;
+        totals.triangles += frame.triangles;
+        totals.passChanges += frame.passChanges;
+        totals.programChanges += frame.programChanges;
+        totals.textureBinds += frame.textureBinds;
+        totals.vaoBinds += frame.vaoBinds;
+        frames++;
+    }
+
+    const FrameStats &lastFrameStats() const
+    {
+        return lastFrame;
+    }
+
+    void release()
+    {
+        glDeleteBuffers(1, &instanceVBO);
+        instanceVBO = 0;
+    }
+
+    void printStats() const
+    {
+        if (frames == 0)
+            return;
+        std::cout << "RenderQueue: per frame " << (float)totals.draws / frames << " draws of "
+                  << (float)totals.instances / frames << " instances, " << (double)totals.triangles / frames << " triangles, "
+                  << (float)totals.stateChanges() / frames << " state changes (" << (float)totals.passChanges / frames
+                  << " passes, " << (float)totals.programChanges / frames << " programs, "
+                  << (float)totals.textureBinds / frames << " texture binds, " << (float)totals.vaoBinds / frames
+                  << " VAO binds) vs " << (float)submissionOrderStateChanges / frames << " in submission order" << std::endl;
+    }
+
+private:
+    // std::sort below this many items, a radix sort over the key bytes above
+    static const size_t RADIX_SORT_THRESHOLD = 256;
+
+    struct Pass
+    {
+        std::string name;
+        std::function<void(Shader &)> setup;
+    };
+
+    struct Item
+    {
+        uint64_t key;
+        Shader *shader;
+        unsigned int pass;
+        unsigned int material;
+        unsigned int VAO;
+        unsigned int firstIndex;
+        unsigned int indexCount;
+        unsigned int indexType;
+        unsigned int firstInstance;
+        unsigned int instanceCount;
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Material> materials;
+    std::vector<unsigned int> programs;
+    std::vector<unsigned int> vertexArrays;
+    std::vector<Item> items;
+    std::vector<Instance> instances;
+    unsigned int instanceVBO = 0;
+    size_t instanceCapacity = 0;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    unsigned int boundTextures[MAX_TEXTURES] = {0, 0, 0, 0};
+
+    FrameStats lastFrame;
+    FrameStats totals;
+    unsigned int frames = 0;
+    unsigned long long submissionOrderStateChanges = 0;
+
+    // maps GL names onto the small indices stored in the key
+    static unsigned int smallIndex(std::vector<unsigned int> &names, unsigned int name)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return i;
+        names.push_back(name);
+        return names.size() - 1;
+    }
+
+    // one upload for the whole frame; the buffer is orphaned rather than overwritten in place, so the driver doesn't
+    // have to wait for the previous frame's draws
+    void uploadInstances()
+    {
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        instanceCapacity = std::max(instanceCapacity, instances.size());
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+    }
+
+    void sortItems()
+    {
+        order.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+            order[i] = SortEntry{items[i].key, (unsigned int)i};
+        if (order.size() < RADIX_SORT_THRESHOLD)
+        {
+            std::sort(order.begin(), order.end(), [](const SortEntry &a, const SortEntry &b) { return a.key < b.key; });
+            return;
+        }
+
+        // least significant digit first, one byte per pass; bytes that are equal for all keys are skipped
+        scratch.resize(order.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256] = {};
+            for (const SortEntry &entry : order)
+                counts[(entry.key >> shift) & 0xFF]++;
+            if (counts[(order[0].key >> shift) & 0xFF] == order.size())
+                continue;
+            size_t offset = 0;
+            for (size_t &count : counts)
+            {
+                size_t bucketSize = count;
+                count = offset;
+                offset += bucketSize;
+            }
+            for (const SortEntry &entry : order)
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            order.swap(scratch);
+        }
+    }
+
+    // the state changes the frame would cost drawn in submission order, for comparison
+    unsigned int simulate() const
+    {
+        unsigned int changes = 0;
+        int pass = -1, material = -1;
+        const Shader *shader = nullptr;
+        unsigned int VAO = 0;
+        unsigned int textures[MAX_TEXTURES] = {0, 0, 0, 0};
+        for (const Item &item : items)
+        {
+            changes += (int)item.pass != pass;
+            changes += item.shader != shader;
+            changes += item.VAO != VAO;
+            if ((int)item.material != material)
+                for (unsigned int unit = 0; unit < MAX_TEXTURES; unit++)
+                {
+                    unsigned int texture = materials[item.material].textures[unit];
+                    if (texture != 0 && textures[unit] != texture)
+                    {
+                        textures[unit] = texture;
+                        changes++;
+                    }
+                }
+            pass = item.pass;
+            shader = item.shader;
+            VAO = item.VAO;
+            material = item.material;
+        }
+        return changes;
+    }
+};
+
+#endif
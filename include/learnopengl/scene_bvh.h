@@ -0,0 +1,270 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_BVH_SSE 1
+#endif
+
+// the six planes of a view frustum, pointing inwards, extracted from a clip space matrix (Gribb/Hartmann)
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4 &viewProjection)
+    {
+        // glm is column major: row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // left
+        frustum.planes[1] = rows[3] - rows[0]; // right
+        frustum.planes[2] = rows[3] + rows[1]; // bottom
+        frustum.planes[3] = rows[3] - rows[1]; // top
+        frustum.planes[4] = rows[3] + rows[2]; // near
+        frustum.planes[5] = rows[3] - rows[2]; // far
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+};
+
+// A bounding volume hierarchy over the world space boxes of the scene's object instances, built once since the
+// scene is static. Every node holds the boxes of up to four children side by side (structure of arrays), so the
+// frustum test checks all four against a plane with a handful of SSE instructions. Children entirely outside a
+// plane are skipped, children entirely inside all planes are accepted without testing anything below them.
+class SceneBVH
+{
+public:
+    struct Stats
+    {
+        unsigned int visible = 0;
+        unsigned int culled = 0;
+        double milliseconds = 0.0;
+    };
+
+    // objects are identified by their index in boxes
+    void build(const std::vector<Bounds> &boxes)
+    {
+        nodes.clear();
+        objects.resize(boxes.size());
+        centers.resize(boxes.size());
+        bounds = boxes;
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            objects[i] = i;
+            centers[i] = 0.5f * (boxes[i].Min + boxes[i].Max);
+        }
+        if (!boxes.empty())
+            buildNode(0, boxes.size());
+        std::vector<glm::vec3>().swap(centers);
+    }
+
+    size_t objectCount() const
+    {
+        return bounds.size();
+    }
+
+    // appends the indices of the objects whose boxes intersect the frustum to visible
+    void cull(const Frustum &frustum, std::vector<unsigned int> &visible)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t first = visible.size();
+        if (!nodes.empty())
+        {
+            stack.clear();
+            stack.push_back(0);
+            while (!stack.empty())
+            {
+                unsigned int index = stack.back();
+                stack.pop_back();
+                const Node &node = nodes[index];
+                unsigned int outside, inside;
+                testNode(node, frustum, outside, inside);
+                for (unsigned int lane = 0; lane < node.count; lane++)
+                {
+                    if (outside & (1u << lane))
+                        continue;
+                    if (node.child[lane] & OBJECT)
+                        visible.push_back(node.child[lane] & ~OBJECT);
+                    else if (inside & (1u << lane))
+                        collect(node.child[lane], visible);
+                    else
+                        stack.push_back(node.child[lane]);
+                }
+            }
+        }
+        last.visible = visible.size() - first;
+        last.culled = bounds.size() - last.visible;
+        last.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        totals.visible += last.visible;
+        totals.culled += last.culled;
+        totals.milliseconds += last.milliseconds;
+        frames++;
+    }
+
+    const Stats &lastFrameStats() const
+    {
+        return last;
+    }
+
+    void printStats() const
+    {
+        if (frames == 0)
+            return;
+        std::cout << "SceneBVH: " << bounds.size() << " objects in " << nodes.size() << " nodes, per frame "
+                  << (float)totals.visible / frames << " visible, " << (float)totals.culled / frames << " culled in "
+                  << totals.milliseconds / frames << " ms" << std::endl;
+    }
+
+private:
+    // child entries with this bit set are object indices, the others node indices
+    static const unsigned int OBJECT = 0x80000000u;
+
+    struct Node
+    {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        unsigned int child[4];
+        unsigned int count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> objects;
+    std::vector<glm::vec3> centers;
+    std::vector<Bounds> bounds;
+    std::vector<unsigned int> stack;
+    Stats last;
+    Stats totals;
+    unsigned int frames = 0;
+
+    // splits objects [begin, end) at the median of the longest axis of their centers
+    size_t split(size_t begin, size_t end)
+    {
+        glm::vec3 low = centers[objects[begin]], high = low;
+        for (size_t i = begin + 1; i < end; i++)
+        {
+            low = glm::min(low, centers[objects[i]]);
+            high = glm::max(high, centers[objects[i]]);
+        }
+        glm::vec3 extent = high - low;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(objects.begin() + begin, objects.begin() + middle, objects.begin() + end,
+                         [this, axis](unsigned int a, unsigned int b) { return centers[a][axis] < centers[b][axis]; });
+        return middle;
+    }
+
+    // builds the node over objects [begin, end) and returns its index; up to four objects become direct children,
+    // more are split in two and each half in two again
+    unsigned int buildNode(size_t begin, size_t end)
+    {
+        unsigned int index = nodes.size();
+        nodes.push_back(Node());
+
+        size_t ranges[5];
+        unsigned int count = 0;
+        if (end - begin <= 4)
+        {
+            for (size_t i = begin; i <= end; i++)
+                ranges[count++] = i;
+            count--;
+        }
+        else
+        {
+            size_t middle = split(begin, end);
+            ranges[0] = begin;
+            ranges[1] = split(begin, middle);
+            ranges[2] = middle;
+            ranges[3] = split(middle, end);
+            ranges[4] = end;
+            count = 4;
+        }
+
+        Node node = {};
+        node.count = count;
+        for (unsigned int lane = 0; lane < count; lane++)
+        {
+            size_t first = ranges[lane], last = ranges[lane + 1];
+            glm::vec3 low = bounds[objects[first]].Min, high = bounds[objects[first]].Max;
+            for (size_t i = first + 1; i < last; i++)
+            {
+                low = glm::min(low, bounds[objects[i]].Min);
+                high = glm::max(high, bounds[objects[i]].Max);
+            }
+            node.minX[lane] = low.x; node.minY[lane] = low.y; node.minZ[lane] = low.z;
+            node.maxX[lane] = high.x; node.maxY[lane] = high.y; node.maxZ[lane] = high.z;
+            node.child[lane] = last - first == 1 ? (objects[first] | OBJECT) : buildNode(first, last);
+        }
+        nodes[index] = node;
+        return index;
+    }
+
+    // per lane bit masks of the boxes outside one of the planes and of those inside all of them
+    static void testNode(const Node &node, const Frustum &frustum, unsigned int &outside, unsigned int &inside)
+    {
+#ifdef SCENE_BVH_SSE
+        __m128 minX = _mm_loadu_ps(node.minX), minY = _mm_loadu_ps(node.minY), minZ = _mm_loadu_ps(node.minZ);
+        __m128 maxX = _mm_loadu_ps(node.maxX), maxY = _mm_loadu_ps(node.maxY), maxZ = _mm_loadu_ps(node.maxZ);
+        __m128 zero = _mm_setzero_ps();
+        __m128 out = zero;
+        __m128 in = _mm_cmpeq_ps(zero, zero);
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            // the corner farthest along the normal decides whether a box is outside, the nearest whether it is inside
+            __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z), d = _mm_set1_ps(plane.w);
+            __m128 farX = plane.x >= 0.0f ? maxX : minX, nearX = plane.x >= 0.0f ? minX : maxX;
+            __m128 farY = plane.y >= 0.0f ? maxY : minY, nearY = plane.y >= 0.0f ? minY : maxY;
+            __m128 farZ = plane.z >= 0.0f ? maxZ : minZ, nearZ = plane.z >= 0.0f ? minZ : maxZ;
+            __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, farX), _mm_mul_ps(ny, farY)), _mm_add_ps(_mm_mul_ps(nz, farZ), d));
+            __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nearX), _mm_mul_ps(ny, nearY)), _mm_add_ps(_mm_mul_ps(nz, nearZ), d));
+            out = _mm_or_ps(out, _mm_cmplt_ps(farDistance, zero));
+            in = _mm_and_ps(in, _mm_cmpge_ps(nearDistance, zero));
+        }
+        outside = _mm_movemask_ps(out);
+        inside = _mm_movemask_ps(in);
+#else
+        outside = 0;
+        inside = 0xF;
+        for (unsigned int lane = 0; lane < 4; lane++)
+            for (const glm::vec4 &plane : frustum.planes)
+            {
+                float farDistance = plane.x * (plane.x >= 0.0f ? node.maxX[lane] : node.minX[lane]) +
+                                    plane.y * (plane.y >= 0.0f ? node.maxY[lane] : node.minY[lane]) +
+                                    plane.z * (plane.z >= 0.0f ? node.maxZ[lane] : node.minZ[lane]) + plane.w;
+                float nearDistance = plane.x * (plane.x >= 0.0f ? node.minX[lane] : node.maxX[lane]) +
+                                     plane.y * (plane.y >= 0.0f ? node.minY[lane] : node.maxY[lane]) +
+                                     plane.z * (plane.z >= 0.0f ? node.minZ[lane] : node.maxZ[lane]) + plane.w;
+                if (farDistance < 0.0f)
+                    outside |= 1u << lane;
+                if (nearDistance < 0.0f)
+                    inside &= ~(1u << lane);
+            }
+#endif
+    }
+
+    // every object below a node that is entirely inside the frustum
+    void collect(unsigned int index, std::vector<unsigned int> &visible) const
+    {
+        const Node &node = nodes[index];
+        for (unsigned int lane = 0; lane < node.count; lane++)
+        {
+            if (node.child[lane] & OBJECT)
+                visible.push_back(node.child[lane] & ~OBJECT);
+            else
+                collect(node.child[lane], visible);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef SCREEN_BLUR_H
+#define SCREEN_BLUR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// A Gaussian blur of the rendered scene whose cost doesn't grow with its radius. The scene texture is
+// downsampled into its mip chain, and the blur runs at the first level where the radius is at most
+// MAX_LEVEL_RADIUS texels: a horizontal and a vertical pass of the separable kernel, between two ping-pong
+// textures of half the scene's resolution (with mip chains of their own, so every level has a matching size).
+// Doubling the radius moves the blur one level down, to a quarter of the pixels, at the same number of taps.
+// The result is left at that level and upsampled by the linear filter of the screen pass.
+class ScreenBlur
+{
+public:
+    // the blur runs at half resolution or below, down to 1/32
+    static const unsigned int MAX_LEVEL = 5;
+    static const unsigned int MAX_LEVEL_RADIUS = 16;
+    // the center texel and MAX_LEVEL_RADIUS / 2 bilinear pairs
+    static const unsigned int MAX_TAPS = 1 + MAX_LEVEL_RADIUS / 2;
+
+    ScreenBlur(unsigned int width, unsigned int height, float radius = 8.0f)
+        : shader("resources/shaders/blur.vs", "resources/shaders/blur.fs"), width(width), height(height)
+    {
+        shader.use();
+        shader.setInt("image"_uniform, 0);
+        // the scene texture's own filter stays as the screen pass needs it; the blur reads its levels through this
+        glGenSamplers(1, &mipSampler);
+        glSamplerParameteri(mipSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+        glSamplerParameteri(mipSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri(mipSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glSamplerParameteri(mipSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(2, pingPongFBOs);
+        glGenTextures(2, pingPongTextures);
+        allocate();
+        // the full screen triangle comes from gl_VertexID, but core profile still wants a VAO bound
+        glGenVertexArrays(1, &emptyVAO);
+        setRadius(radius);
+    }
+
+    // the standard deviation of the Gaussian is a third of the radius, in pixels of the scene; at most 512 pixels,
+    // MAX_LEVEL_RADIUS at the lowest level
+    void setRadius(float pixels)
+    {
+        blurRadius = std::min(std::max(1.0f, pixels), (float)(MAX_LEVEL_RADIUS << MAX_LEVEL));
+        blurLevel = 1;
+        while (blurLevel < MAX_LEVEL && blurRadius / (1 << blurLevel) > MAX_LEVEL_RADIUS)
+            blurLevel++;
+        float radius = blurRadius / (1 << blurLevel);
+        float sigma = std::max(radius / 3.0f, 0.5f);
+        int texels = std::min((int)MAX_LEVEL_RADIUS, (int)std::ceil(radius));
+
+        float kernel[MAX_LEVEL_RADIUS + 2] = {};
+        float sum = 0.0f;
+        for (int i = 0; i <= texels; i++)
+        {
+            kernel[i] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+            sum += i == 0 ? kernel[i] : 2.0f * kernel[i];
+        }
+        offsets[0] = 0.0f;
+        weights[0] = kernel[0] / sum;
+        taps = 1;
+        for (int i = 1; i <= texels; i += 2)
+        {
+            float weight = kernel[i] + kernel[i + 1];
+            offsets[taps] = (i * kernel[i] + (i + 1) * kernel[i + 1]) / weight;
+            weights[taps] = weight / sum;
+            taps++;
+        }
+        kernelChanged = true;
+    }
+
+    float radius() const
+    {
+        return blurRadius;
+    }
+
+    // follows the scene texture to a new size; the radius stays in pixels of the scene
+    void resize(unsigned int sceneWidth, unsigned int sceneHeight)
+    {
+        if (sceneWidth == width && sceneHeight == height)
+            return;
+        width = sceneWidth;
+        height = sceneHeight;
+        allocate();
+    }
+
+    // blurs level 0 of the scene texture (width x height) and returns the texture holding the result at
+    // resultLod(); leaves framebuffer 0 bound, with the viewport restored and GL_TEXTURE0 active
+    unsigned int apply(unsigned int sceneTexture)
+    {
+        GpuProfiler::instance().begin("blur");
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        // only the levels down to the one the blur reads
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, blurLevel);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        shader.use();
+        if (kernelChanged)
+        {
+            shader.setInt("taps"_uniform, taps);
+            for (unsigned int i = 0; i < taps; i++)
+            {
+                shader.setFloat("offsets[" + std::to_string(i) + "]", offsets[i]);
+                shader.setFloat("weights[" + std::to_string(i) + "]", weights[i]);
+            }
+            kernelChanged = false;
+        }
+        unsigned int levelWidth = std::max(1u, width >> blurLevel), levelHeight = std::max(1u, height >> blurLevel);
+        glViewport(0, 0, levelWidth, levelHeight);
+        glBindVertexArray(emptyVAO);
+
+        glBindSampler(0, mipSampler);
+        blurPass(0, blurLevel, glm::vec2(1.0f / levelWidth, 0.0f));
+        glBindSampler(0, 0);
+        glBindTexture(GL_TEXTURE_2D, pingPongTextures[0]);
+        blurPass(1, blurLevel - 1, glm::vec2(0.0f, 1.0f / levelHeight));
+
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        GpuProfiler::instance().end();
+        return pingPongTextures[1];
+    }
+
+    // the level of the texture apply() returned that holds the blurred scene
+    float resultLod() const
+    {
+        return (float)(blurLevel - 1);
+    }
+
+    void release()
+    {
+        glDeleteFramebuffers(2, pingPongFBOs);
+        glDeleteTextures(2, pingPongTextures);
+        glDeleteSamplers(1, &mipSampler);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+private:
+    Shader shader;
+    unsigned int width, height;
+    unsigned int pingPongFBOs[2] = {}, pingPongTextures[2] = {};
+    unsigned int mipSampler = 0;
+    unsigned int emptyVAO = 0;
+    float blurRadius = 0.0f;
+    unsigned int blurLevel = 1;
+    unsigned int taps = 1;
+    float offsets[MAX_TAPS] = {}, weights[MAX_TAPS] = {};
+    bool kernelChanged = true;
+
+    // the ping-pong textures at half the scene's size, with the levels the blur can run at
+    void allocate()
+    {
+        for (unsigned int texture : pingPongTextures)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            for (unsigned int level = 0; level < MAX_LEVEL; level++)
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGB8, std::max(1u, width >> (level + 1)), std::max(1u, height >> (level + 1)), 0,
+                             GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MAX_LEVEL - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // one direction of the kernel from the texture bound to unit 0, read at level lod, into the level of ping-pong
+    // texture target that has the blur's size
+    void blurPass(unsigned int target, unsigned int lod, const glm::vec2 &direction)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, pingPongFBOs[target]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingPongTextures[target], blurLevel - 1);
+        shader.setFloat("lod"_uniform, (float)lod);
+        shader.setVec2("direction"_uniform, direction);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+};
+
+#endif
@@ -4,11 +4,16 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <common.h>
+#include <learnopengl/uniform_id.h>
+#include <learnopengl/program_binary_cache.h>
 class Shader
 {
 public:
@@ -50,30 +55,18 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        // 2. reuse the linked program from the program binary cache if the driver accepts it, compile it otherwise
+        std::string cachePath = ProgramBinaryCache::cachePathFor(vertexPathString, fragmentPathString);
+        ID = ProgramBinaryCache::load(cachePath, vertexCode, fragmentCode);
+        if (ID == 0)
+            ID = compile(cachePath, vertexCode, fragmentCode);
+        // 3. look up every active uniform once; two names with the same hash would write each other's uniforms, so
+        // the program is unusable, like one that failed to link
+        if (!buildUniformTable())
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+        }
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -82,65 +75,224 @@ public:
         glUseProgram(ID); 
     }
     // utility uniform functions
+    // the std::string overloads hash the name at run time; prefer the UniformID ones with a "name"_uniform literal
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(UniformID(name.c_str())), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(UniformID(name.c_str())), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(UniformID(name.c_str())), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(UniformID(name.c_str())), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(UniformID(name.c_str())), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(UniformID(name.c_str())), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(UniformID(name.c_str())), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(UniformID(name.c_str())), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(UniformID(name.c_str())), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(UniformID(name.c_str())), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(UniformID(name.c_str())), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(UniformID(name.c_str())), 1, GL_FALSE, &mat[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    void setBool(UniformID id, bool value) const
+    {         
+        glUniform1i(location(id), (int)value); 
+    }
+    void setInt(UniformID id, int value) const
+    { 
+        glUniform1i(location(id), value); 
+    }
+    void setFloat(UniformID id, float value) const
+    { 
+        glUniform1f(location(id), value); 
+    }
+    void setVec2(UniformID id, const glm::vec2 &value) const
+    { 
+        glUniform2fv(location(id), 1, &value[0]); 
+    }
+    void setVec2(UniformID id, float x, float y) const
+    { 
+        glUniform2f(location(id), x, y); 
+    }
+    void setVec3(UniformID id, const glm::vec3 &value) const
+    { 
+        glUniform3fv(location(id), 1, &value[0]); 
+    }
+    void setVec3(UniformID id, float x, float y, float z) const
+    { 
+        glUniform3f(location(id), x, y, z); 
+    }
+    void setVec4(UniformID id, const glm::vec4 &value) const
+    { 
+        glUniform4fv(location(id), 1, &value[0]); 
+    }
+    void setVec4(UniformID id, float x, float y, float z, float w) const
+    { 
+        glUniform4f(location(id), x, y, z, w); 
+    }
+    void setMat2(UniformID id, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(location(id), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformID id, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(location(id), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformID id, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location(id), 1, GL_FALSE, &mat[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    // location of an active uniform, or -1 (which glUniform* ignores) if the program has no such uniform
+    GLint location(UniformID id) const
+    {
+        unsigned int mask = uniformTable.size() - 1;
+        for (unsigned int slot = id.hash & mask; ; slot = (slot + 1) & mask)
+        {
+            const UniformSlot &entry = uniformTable[slot];
+            if (entry.location == EMPTY_SLOT)
+                return -1;
+            if (entry.hash == id.hash)
+                return entry.location;
+        }
     }
 
 private:
+    // open addressing table from name hash to location, filled once after linking
+    struct UniformSlot
+    {
+        uint32_t hash;
+        GLint location;
+    };
+    static const GLint EMPTY_SLOT = -2;
+    std::vector<UniformSlot> uniformTable;
+
+    unsigned int compile(const std::string &cachePath, const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        ProgramBinaryCache::prepare(program);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked)
+            ProgramBinaryCache::store(cachePath, vertexCode, fragmentCode, program);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return program;
+    }
+
+    // enumerates the program's active uniforms; arrays are entered both by their base name and per element. Returns
+    // false, leaving an empty table, if two names hash alike
+    bool buildUniformTable()
+    {
+        std::vector<std::pair<std::string, GLint>> uniforms;
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, buffer.size(), NULL, &size, &type, buffer.data());
+            std::string name(buffer.data());
+            GLint baseLocation = glGetUniformLocation(ID, name.c_str());
+            if (baseLocation < 0)
+                continue; // member of a uniform block
+            uniforms.push_back(std::make_pair(name, baseLocation));
+            size_t bracket = name.find("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size())
+            {
+                std::string baseName = name.substr(0, bracket);
+                uniforms.push_back(std::make_pair(baseName, baseLocation));
+                for (GLint element = 1; element < size; element++)
+                    uniforms.push_back(std::make_pair(baseName + "[" + std::to_string(element) + "]", baseLocation + element));
+            }
+        }
+
+        size_t capacity = 16;
+        while (capacity < uniforms.size() * 2)
+            capacity *= 2;
+        uniformTable.assign(capacity, UniformSlot{0, EMPTY_SLOT});
+        std::vector<const std::string *> slotNames(capacity, nullptr);
+        unsigned int mask = capacity - 1;
+        for (const std::pair<std::string, GLint> &uniform : uniforms)
+        {
+            uint32_t hash = UniformID(uniform.first.c_str()).hash;
+            unsigned int slot = hash & mask;
+            while (uniformTable[slot].location != EMPTY_SLOT && uniformTable[slot].hash != hash)
+                slot = (slot + 1) & mask;
+            if (uniformTable[slot].location != EMPTY_SLOT)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION between " << *slotNames[slot] << " and " << uniform.first
+                          << "; rename one of them" << std::endl;
+                uniformTable.assign(16, UniformSlot{0, EMPTY_SLOT});
+                return false;
+            }
+            uniformTable[slot] = UniformSlot{hash, uniform.second};
+            slotNames[slot] = &uniform.first;
+        }
+        return true;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
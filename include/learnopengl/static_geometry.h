@@ -0,0 +1,184 @@
+#ifndef STATIC_GEOMETRY_H
+#define STATIC_GEOMETRY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Geometry that never changes after start-up (room surfaces, crates, decals). Surfaces are added as triangle
+// lists, get their tangent frames computed once, are welded into indexed vertices and end up in a single
+// vertex/index buffer pair behind one VAO with the same attribute layout as Mesh. Drawing a surface is then a
+// glDrawElements over its index range; nothing is recomputed or re-uploaded per frame.
+class StaticGeometry
+{
+public:
+    struct Surface
+    {
+        unsigned int firstIndex = 0;
+        unsigned int indexCount = 0;
+        // bounds of the baked vertices, i.e. after the transforms passed to add()
+        Bounds bounds;
+    };
+
+    unsigned int VAO = 0;
+
+    // interleaved position/normal/texcoord triangles (8 floats per vertex), as used for the hand written quads
+    static vector<Vertex> fromInterleaved(const float *data, size_t vertexCount)
+    {
+        vector<Vertex> vertices(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const float *v = data + i * 8;
+            vertices[i].Position = glm::vec3(v[0], v[1], v[2]);
+            vertices[i].Normal = glm::vec3(v[3], v[4], v[5]);
+            vertices[i].TexCoords = glm::vec2(v[6], v[7]);
+        }
+        return vertices;
+    }
+
+    // a quad given corner by corner, split into the triangles (1, 2, 3) and (1, 3, 4)
+    static vector<Vertex> quad(glm::vec3 pos1, glm::vec3 pos2, glm::vec3 pos3, glm::vec3 pos4,
+                               glm::vec2 uv1, glm::vec2 uv2, glm::vec2 uv3, glm::vec2 uv4, glm::vec3 normal)
+    {
+        const glm::vec3 positions[] = {pos1, pos2, pos3, pos1, pos3, pos4};
+        const glm::vec2 texCoords[] = {uv1, uv2, uv3, uv1, uv3, uv4};
+        vector<Vertex> vertices(6);
+        for (int i = 0; i < 6; i++)
+        {
+            vertices[i].Position = positions[i];
+            vertices[i].Normal = normal;
+            vertices[i].TexCoords = texCoords[i];
+        }
+        return vertices;
+    }
+
+    // appends a triangle list transformed by model (rigid transforms and uniform scale only); the returned
+    // surface is drawn with an identity model matrix, or with further per-draw transforms for props
+    Surface add(const vector<Vertex> &triangles, const glm::mat4 &model = glm::mat4(1.0f))
+    {
+        return add(triangles, vector<glm::mat4>(1, model));
+    }
+
+    // one copy of the triangle list per transform, all in a single surface
+    Surface add(const vector<Vertex> &triangles, const vector<glm::mat4> &models)
+    {
+        Surface surface;
+        surface.firstIndex = indices.size();
+        vector<Vertex> baked;
+        for (const glm::mat4 &model : models)
+        {
+            glm::mat3 basis(model);
+            for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+            {
+                glm::vec3 tangent, bitangent;
+                tangentFrame(triangles[i], triangles[i + 1], triangles[i + 2], tangent, bitangent);
+                for (size_t corner = i; corner < i + 3; corner++)
+                {
+                    Vertex vertex = triangles[corner];
+                    vertex.Position = glm::vec3(model * glm::vec4(vertex.Position, 1.0f));
+                    vertex.Normal = glm::normalize(basis * vertex.Normal);
+                    vertex.Tangent = basis * tangent;
+                    vertex.Bitangent = basis * bitangent;
+                    indices.push_back(weld(vertex));
+                    baked.push_back(vertex);
+                }
+            }
+            triangleVertices += triangles.size();
+        }
+        surface.indexCount = indices.size() - surface.firstIndex;
+        surface.bounds = Bounds::fromPositions(baked.data(), baked.size());
+        return surface;
+    }
+
+    // uploads everything added so far; the CPU copies are released afterwards
+    void build()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glBindVertexArray(0);
+
+        std::cout << "StaticGeometry: " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices ("
+                  << triangleVertices << " before welding), "
+                  << (vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int)) / 1024 << " KiB" << std::endl;
+
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        std::unordered_map<std::string, unsigned int>().swap(vertexIndex);
+    }
+
+    void release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+    }
+
+private:
+    unsigned int VBO = 0, EBO = 0;
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    // bitwise identical vertices share an index
+    std::unordered_map<std::string, unsigned int> vertexIndex;
+    size_t triangleVertices = 0;
+
+    unsigned int weld(const Vertex &vertex)
+    {
+        std::string key((const char *)&vertex, sizeof(Vertex));
+        auto found = vertexIndex.find(key);
+        if (found != vertexIndex.end())
+            return found->second;
+        unsigned int index = vertices.size();
+        vertices.push_back(vertex);
+        vertexIndex[key] = index;
+        return index;
+    }
+
+    // tangent and bitangent of a triangle from its position and texture coordinate deltas
+    static void tangentFrame(const Vertex &v1, const Vertex &v2, const Vertex &v3, glm::vec3 &tangent, glm::vec3 &bitangent)
+    {
+        glm::vec3 edge1 = v2.Position - v1.Position;
+        glm::vec3 edge2 = v3.Position - v1.Position;
+        glm::vec2 deltaUV1 = v2.TexCoords - v1.TexCoords;
+        glm::vec2 deltaUV2 = v3.TexCoords - v1.TexCoords;
+
+        float determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+        if (determinant == 0.0f)
+        {
+            // degenerate texture mapping; only normal mapped surfaces read the frame
+            tangent = glm::vec3(0.0f);
+            bitangent = glm::vec3(0.0f);
+            return;
+        }
+        float f = 1.0f / determinant;
+        tangent = f * (deltaUV2.y * edge1 - deltaUV1.y * edge2);
+        bitangent = f * (-deltaUV2.x * edge1 + deltaUV1.x * edge2);
+    }
+};
+
+#endif
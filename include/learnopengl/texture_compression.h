@@ -0,0 +1,551 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// S3TC isn't part of core OpenGL, so glad doesn't define its enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// what a texture is sampled for, which decides the block format it is compressed to:
+// Color    -> BC1, or BC3 if the image has an alpha channel that isn't fully opaque
+// Specular -> BC4 (the shaders only read the red channel)
+// Height   -> BC4
+// Normal   -> BC5 (x/y only, normalMappingShader.fs reconstructs z)
+// ConeStep -> BC5 (a depth map turned into a relaxed cone step map, see cone_step_map.h); the cones are encoded
+//             rounded down and reduced to the narrowest in each coarser mip level, so they stay conservative
+enum class TextureUsage
+{
+    Color,
+    Specular,
+    Normal,
+    Height,
+    ConeStep
+};
+
+// a block-compressed image with its full mip chain, level 0 first
+struct CompressedImage
+{
+    struct Level
+    {
+        int width, height;
+        size_t offset, size;
+    };
+
+    GLenum format = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// bytes per 4x4 block of the supported formats
+inline size_t compressedBlockSize(GLenum format)
+{
+    return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+}
+
+// the formats a texture with this usage may have been cached as, preferred first
+inline std::vector<GLenum> compressedFormatsFor(TextureUsage usage, bool s3tcSupported)
+{
+    switch (usage)
+    {
+        case TextureUsage::Color:
+            if (s3tcSupported)
+                return {GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT};
+            return {};
+        case TextureUsage::Specular:
+        case TextureUsage::Height:
+            return {GL_COMPRESSED_RED_RGTC1};
+        case TextureUsage::Normal:
+        case TextureUsage::ConeStep:
+            return {GL_COMPRESSED_RG_RGTC2};
+    }
+    return {};
+}
+
+// cache file of a source image, e.g. resources/textures/BRICKS.jpg -> resources/textures/BRICKS.jpg.bc1.dds; cone step
+// maps are derived data rather than a re-encoding of the image, so they get a cache of their own
+inline std::string compressedCachePath(const std::string &sourcePath, GLenum format, TextureUsage usage)
+{
+    // .cone2: the cones of older caches weren't conservative in compressed form and at coarser levels
+    if (usage == TextureUsage::ConeStep)
+        return sourcePath + ".cone2.bc5.dds";
+    const char *suffix = ".bc1.dds";
+    if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        suffix = ".bc3.dds";
+    else if (format == GL_COMPRESSED_RED_RGTC1)
+        suffix = ".bc4.dds";
+    else if (format == GL_COMPRESSED_RG_RGTC2)
+        suffix = ".bc5.dds";
+    return sourcePath + suffix;
+}
+
+// a cache file is usable if it exists and isn't older than its source image
+inline bool compressedCacheIsFresh(const std::string &sourcePath, const std::string &cachePath)
+{
+    struct stat source, cache;
+    if (stat(cachePath.c_str(), &cache) != 0)
+        return false;
+    if (stat(sourcePath.c_str(), &source) != 0)
+        return true;
+    return cache.st_mtime >= source.st_mtime;
+}
+
+// block encoders
+// ------------------------------------------------------------------------
+// all of them take the 16 texels of a 4x4 block as RGBA8, row by row
+
+inline uint16_t packRGB565(const float color[3])
+{
+    int r = std::min(31, std::max(0, (int)std::lround(color[0] * 31.0f / 255.0f)));
+    int g = std::min(63, std::max(0, (int)std::lround(color[1] * 63.0f / 255.0f)));
+    int b = std::min(31, std::max(0, (int)std::lround(color[2] * 31.0f / 255.0f)));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRGB565(uint16_t packed, float color[3])
+{
+    color[0] = (float)((packed >> 11) & 31) * 255.0f / 31.0f;
+    color[1] = (float)((packed >> 5) & 63) * 255.0f / 63.0f;
+    color[2] = (float)(packed & 31) * 255.0f / 31.0f;
+}
+
+// BC1 color block; the endpoints are the extremes of the block's colors along their principal axis
+inline void encodeBC1Block(const unsigned char texels[16][4], unsigned char out[8])
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += texels[i][c] / 16.0f;
+
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++)
+    {
+        float r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+    // power iteration for the dominant eigenvector
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float projection = 0.0f;
+        for (int c = 0; c < 3; c++)
+            projection += (texels[i][c] - mean[c]) * axis[c];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float endpoints[2][3];
+    for (int c = 0; c < 3; c++)
+    {
+        endpoints[0][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxProjection / axisLengthSquared));
+        endpoints[1][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minProjection / axisLengthSquared));
+    }
+
+    uint16_t color0 = packRGB565(endpoints[0]);
+    uint16_t color1 = packRGB565(endpoints[1]);
+    // color0 > color1 selects the four color mode
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        float palette[4][3];
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float bestDistance = 1e30f;
+            for (int p = 0; p < 4; p++)
+            {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; c++)
+                    distance += (texels[i][c] - palette[p][c]) * (texels[i][c] - palette[p][c]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// BC4 block of one channel, using the eight value ramp between the channel's minimum and maximum. With roundDown
+// every texel gets the highest ramp value that isn't above it rather than the nearest one.
+inline void encodeBC4Block(const unsigned char texels[16][4], int channel, unsigned char out[8], bool roundDown = false)
+{
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        minValue = std::min(minValue, (int)texels[i][channel]);
+        maxValue = std::max(maxValue, (int)texels[i][channel]);
+    }
+
+    out[0] = (unsigned char)maxValue;
+    out[1] = (unsigned char)minValue;
+    uint64_t indices = 0;
+    if (maxValue > minValue)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            // position on the ramp from minimum (0) to maximum (7)
+            int step = roundDown ? (texels[i][channel] - minValue) * 7 / (maxValue - minValue)
+                                 : (int)std::lround((texels[i][channel] - minValue) * 7.0f / (maxValue - minValue));
+            uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+            indices |= index << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// the values a BC4 block decodes to, in [0, 1] as the GPU samples them
+inline void decodeBC4Block(const unsigned char block[8], float values[16])
+{
+    float palette[8];
+    palette[0] = block[0] / 255.0f;
+    palette[1] = block[1] / 255.0f;
+    if (block[0] > block[1])
+    {
+        for (int i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7.0f;
+    }
+    else
+    {
+        for (int i = 2; i < 6; i++)
+            palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5.0f;
+        palette[6] = 0.0f;
+        palette[7] = 1.0f;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++)
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++)
+        values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+// decodes one level of a BC5 image into interleaved red/green floats, for CPU models of the shaders
+inline std::vector<float> decodeBC5Level(const CompressedImage &image, size_t level)
+{
+    const CompressedImage::Level &info = image.levels[level];
+    std::vector<float> rg(info.width * info.height * 2);
+    int blocksX = (info.width + 3) / 4, blocksY = (info.height + 3) / 4;
+    const unsigned char *block = &image.data[info.offset];
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++, block += 16)
+        {
+            float values[2][16];
+            decodeBC4Block(block, values[0]);
+            decodeBC4Block(block + 8, values[1]);
+            for (int i = 0; i < 16; i++)
+            {
+                int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                if (x >= info.width || y >= info.height)
+                    continue;
+                rg[(y * info.width + x) * 2] = values[0][i];
+                rg[(y * info.width + x) * 2 + 1] = values[1][i];
+            }
+        }
+    }
+    return rg;
+}
+
+// mip chain
+// ------------------------------------------------------------------------
+
+// halves an RGBA8 image with a box filter; normal maps are renormalized after averaging, and the cone of a cone step
+// map texel is the narrowest of the four it covers, since a wider one could reach into relief beside them
+inline std::vector<unsigned char> downsampleRGBA(const std::vector<unsigned char> &source, int width, int height, TextureUsage usage)
+{
+    int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+    std::vector<unsigned char> result(nextWidth * nextHeight * 4);
+    for (int y = 0; y < nextHeight; y++)
+    {
+        for (int x = 0; x < nextWidth; x++)
+        {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            float narrowestCone = 255.0f;
+            for (int dy = 0; dy < 2; dy++)
+            {
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int sx = std::min(width - 1, 2 * x + dx), sy = std::min(height - 1, 2 * y + dy);
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += source[(sy * width + sx) * 4 + c] / 4.0f;
+                    narrowestCone = std::min(narrowestCone, (float)source[(sy * width + sx) * 4 + 1]);
+                }
+            }
+            if (usage == TextureUsage::ConeStep)
+                sum[1] = narrowestCone;
+            if (usage == TextureUsage::Normal)
+            {
+                float n[3], length = 0.0f;
+                for (int c = 0; c < 3; c++)
+                {
+                    n[c] = sum[c] / 127.5f - 1.0f;
+                    length += n[c] * n[c];
+                }
+                length = std::sqrt(length);
+                if (length > 1e-6f)
+                    for (int c = 0; c < 3; c++)
+                        sum[c] = (n[c] / length + 1.0f) * 127.5f;
+            }
+            for (int c = 0; c < 4; c++)
+                result[(y * nextWidth + x) * 4 + c] = (unsigned char)std::min(255.0f, std::max(0.0f, std::round(sum[c])));
+        }
+    }
+    return result;
+}
+
+// expands a stbi_load result with nrComponents channels to RGBA8
+inline std::vector<unsigned char> expandToRGBA(const unsigned char *data, int width, int height, int nrComponents)
+{
+    std::vector<unsigned char> rgba(width * height * 4);
+    for (int i = 0; i < width * height; i++)
+    {
+        const unsigned char *texel = data + i * nrComponents;
+        unsigned char *target = &rgba[i * 4];
+        if (nrComponents <= 2)
+        {
+            target[0] = target[1] = target[2] = texel[0];
+            target[3] = nrComponents == 2 ? texel[1] : 255;
+        }
+        else
+        {
+            target[0] = texel[0];
+            target[1] = texel[1];
+            target[2] = texel[2];
+            target[3] = nrComponents == 4 ? texel[3] : 255;
+        }
+    }
+    return rgba;
+}
+
+// encodes a decoded image and its whole mip chain. Returns false if no block format fits the usage.
+inline bool compressImage(const unsigned char *data, int width, int height, int nrComponents, TextureUsage usage,
+                          bool s3tcSupported, CompressedImage &image)
+{
+    std::vector<unsigned char> level = expandToRGBA(data, width, height, nrComponents);
+
+    switch (usage)
+    {
+        case TextureUsage::Color:
+        {
+            if (!s3tcSupported)
+                return false;
+            bool opaque = true;
+            for (size_t i = 3; i < level.size() && opaque; i += 4)
+                opaque = level[i] == 255;
+            image.format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        }
+        case TextureUsage::Specular:
+        case TextureUsage::Height:
+            image.format = GL_COMPRESSED_RED_RGTC1;
+            break;
+        case TextureUsage::Normal:
+        case TextureUsage::ConeStep:
+            image.format = GL_COMPRESSED_RG_RGTC2;
+            break;
+    }
+
+    size_t blockSize = compressedBlockSize(image.format);
+    image.levels.clear();
+    image.data.clear();
+    while (true)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        CompressedImage::Level info = {width, height, image.data.size(), blocksX * blocksY * blockSize};
+        image.levels.push_back(info);
+        image.data.resize(info.offset + info.size);
+        unsigned char *out = &image.data[info.offset];
+
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++, out += blockSize)
+            {
+                // gather the block, replicating the edge texels of images that aren't a multiple of 4
+                unsigned char texels[16][4];
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = std::min(width - 1, bx * 4 + i % 4), y = std::min(height - 1, by * 4 + i / 4);
+                    memcpy(texels[i], &level[(y * width + x) * 4], 4);
+                }
+
+                if (image.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                    encodeBC1Block(texels, out);
+                else if (image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                {
+                    encodeBC4Block(texels, 3, out);
+                    encodeBC1Block(texels, out + 8);
+                }
+                else if (image.format == GL_COMPRESSED_RED_RGTC1)
+                    encodeBC4Block(texels, 0, out);
+                else
+                {
+                    encodeBC4Block(texels, 0, out);
+                    encodeBC4Block(texels, 1, out + 8, usage == TextureUsage::ConeStep);
+                }
+            }
+        }
+
+        if (width == 1 && height == 1)
+            break;
+        level = downsampleRGBA(level, width, height, usage);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+
+// DDS container
+// ------------------------------------------------------------------------
+// only what's needed for our own cache files: legacy FourCC codes DXT1, DXT5, ATI1 and ATI2 with a full mip chain
+
+struct DDSHeader
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    // pixel format
+    uint32_t pfSize;
+    uint32_t pfFlags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t bitMasks[4];
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+inline uint32_t ddsFourCC(char a, char b, char c, char d)
+{
+    return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24);
+}
+
+inline bool writeCompressedImage(const std::string &path, const CompressedImage &image)
+{
+    DDSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ddsFourCC('D', 'D', 'S', ' ');
+    header.size = 124;
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+    header.width = image.levels[0].width;
+    header.height = image.levels[0].height;
+    header.pitchOrLinearSize = image.levels[0].size;
+    header.mipMapCount = image.levels.size();
+    header.pfSize = 32;
+    header.pfFlags = 0x4; // fourCC
+    if (image.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        header.fourCC = ddsFourCC('D', 'X', 'T', '1');
+    else if (image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        header.fourCC = ddsFourCC('D', 'X', 'T', '5');
+    else if (image.format == GL_COMPRESSED_RED_RGTC1)
+        header.fourCC = ddsFourCC('A', 'T', 'I', '1');
+    else
+        header.fourCC = ddsFourCC('A', 'T', 'I', '2');
+    header.caps[0] = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)image.data.data(), image.data.size());
+    out.close();
+    if (!out)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+inline bool readCompressedImage(const std::string &path, CompressedImage &image)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    DDSHeader header;
+    if (!in.read((char *)&header, sizeof(header)) || header.magic != ddsFourCC('D', 'D', 'S', ' ') || header.size != 124)
+        return false;
+
+    if (header.fourCC == ddsFourCC('D', 'X', 'T', '1'))
+        image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else if (header.fourCC == ddsFourCC('D', 'X', 'T', '5'))
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else if (header.fourCC == ddsFourCC('A', 'T', 'I', '1'))
+        image.format = GL_COMPRESSED_RED_RGTC1;
+    else if (header.fourCC == ddsFourCC('A', 'T', 'I', '2'))
+        image.format = GL_COMPRESSED_RG_RGTC2;
+    else
+        return false;
+
+    image.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    image.levels.clear();
+    size_t blockSize = compressedBlockSize(image.format);
+    int width = header.width, height = header.height;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < std::max(1u, header.mipMapCount); i++)
+    {
+        size_t size = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+        if (offset + size > image.data.size())
+            return false;
+        CompressedImage::Level level = {width, height, offset, size};
+        image.levels.push_back(level);
+        offset += size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <stb_image.h>
+
+#include <learnopengl/cone_step_map.h>
+#include <learnopengl/texture_compression.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decodes image files on a pool of worker threads and uploads the decoded pixels on the GL thread.
+// load() reserves a texture name right away and queues the file for decoding, so callers can keep
+// handing out texture ids while stbi_load runs in the background. finish() must be called on the
+// thread that owns the GL context before the textures are sampled; it uploads every decoded image
+// as soon as it becomes available.
+// With compression enabled the workers first look for a block-compressed cache of the file
+// (see texture_compression.h) and otherwise encode one, including its mip chain, on first use.
+//
+// After startStreaming() the uploads move off the render thread: a hidden window sharing the main
+// context uploads each mip chain through a ring of pixel buffer objects, coarsest level first, and
+// update() (called once per frame) makes every level the render thread can safely see available by
+// lowering the texture's base level. Textures therefore sharpen over a few frames instead of stalling one.
+class TextureLoader
+{
+public:
+    // the loader shared by loadTexture() in main.cpp and TextureFromFile() in model.h
+    static TextureLoader &instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    explicit TextureLoader(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+
+    // a program that returns without stopStreaming() still gets its upload thread joined here, since destroying a
+    // joinable std::thread terminates; its context is gone by then, so call stopStreaming() before glfwTerminate()
+    ~TextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            streamingStopping = true;
+        }
+        pendingCondition.notify_all();
+        decodedCondition.notify_all();
+        if (uploadThread.joinable())
+            uploadThread.join();
+        for (std::thread &worker : workers)
+            worker.join();
+        for (std::unique_ptr<Job> &job : decoded)
+            stbi_image_free(job->data);
+    }
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    // upload block-compressed textures from (or into) the .dds cache next to each image
+    bool compression = true;
+
+    // reserves a texture name and queues the file for decoding. Must be called on the GL thread.
+    unsigned int load(const std::string &path, TextureUsage usage = TextureUsage::Color)
+    {
+        std::unique_ptr<Job> job(new Job());
+        job->path = path;
+        job->usage = usage;
+        job->compress = compression;
+        job->s3tcSupported = s3tcSupported();
+        glGenTextures(1, &job->textureID);
+        unsigned int textureID = job->textureID;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outstanding == 0)
+                batchStart = std::chrono::steady_clock::now();
+            outstanding++;
+            job->mipChain = streaming;
+            pending.push_back(std::move(job));
+        }
+        pendingCondition.notify_one();
+        return textureID;
+    }
+
+    // blocks until every queued file is decoded and uploaded. Without streaming the uploads happen right here,
+    // each one as soon as its worker is done; with streaming this waits for the upload thread.
+    void finish()
+    {
+        unsigned int uploaded = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        if (streaming)
+        {
+            while (outstanding > 0 || !published.empty() || !visiblePending.empty())
+            {
+                lock.unlock();
+                update(0.0f);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                lock.lock();
+            }
+        }
+        while (outstanding > 0)
+        {
+            decodedCondition.wait(lock, [this] { return !decoded.empty(); });
+            std::unique_ptr<Job> job = std::move(decoded.front());
+            decoded.pop_front();
+            outstanding--;
+
+            lock.unlock();
+            upload(*job);
+            uploaded++;
+            lock.lock();
+        }
+        if (uploaded > 0)
+            printBatchStats(uploaded);
+    }
+
+    // starts the background upload thread on a hidden window sharing mainWindow's context.
+    // Must be called on the main thread, with mainWindow's context current.
+    bool startStreaming(GLFWwindow *mainWindow)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        uploadWindow = glfwCreateWindow(1, 1, "texture streaming", NULL, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (uploadWindow == NULL)
+        {
+            std::cout << "WARNING::TEXTURE:: failed to create the shared upload context, textures are uploaded synchronously" << std::endl;
+            return false;
+        }
+        glfwMakeContextCurrent(mainWindow);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            streaming = true;
+            streamingStopping = false;
+        }
+        uploadThread = std::thread(&TextureLoader::uploadLoop, this);
+        return true;
+    }
+
+    // joins the upload thread and destroys its context. Call before glfwTerminate().
+    void stopStreaming()
+    {
+        if (!uploadThread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            streamingStopping = true;
+        }
+        decodedCondition.notify_all();
+        uploadThread.join();
+        glfwDestroyWindow(uploadWindow);
+        uploadWindow = NULL;
+        for (Published &level : visiblePending)
+            glDeleteSync(level.fence);
+        for (Published &level : published)
+            glDeleteSync(level.fence);
+        visiblePending.clear();
+        published.clear();
+        streaming = false;
+        std::cout << "TextureLoader: " << hitchFrames << " of " << frames << " frames had an upload-induced hitch" << std::endl;
+    }
+
+    // called once per frame on the render thread: exposes every streamed mip level whose upload has completed
+    // and records whether this frame hitched while uploads were in flight. Never blocks.
+    void update(float deltaTime)
+    {
+        if (!streaming)
+            return;
+        bool uploading;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (Published &level : published)
+                visiblePending.push_back(level);
+            published.clear();
+            uploading = outstanding > 0;
+        }
+        uploading = uploading || !visiblePending.empty();
+
+        // fences of one context signal in order, so stop at the first one that hasn't
+        while (!visiblePending.empty())
+        {
+            Published &level = visiblePending.front();
+            GLenum status = glClientWaitSync(level.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(level.fence);
+            glBindTexture(GL_TEXTURE_2D, level.textureID);
+            if (level.level == level.levelCount - 1)
+            {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level.levelCount - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level.level);
+            visiblePending.pop_front();
+        }
+
+        if (deltaTime <= 0.0f)
+            return;
+        // a frame counts as a hitch if it took twice as long as the recent average while uploads were running
+        frames++;
+        if (uploading && averageFrameTime > 0.0f && deltaTime > 2.0f * averageFrameTime)
+            hitchFrames++;
+        averageFrameTime = averageFrameTime > 0.0f ? 0.9f * averageFrameTime + 0.1f * deltaTime : deltaTime;
+    }
+
+    // frames update() saw while uploads were in flight that took more than twice the average frame time
+    unsigned int getHitchFrames() const
+    {
+        return hitchFrames;
+    }
+
+private:
+    struct Job
+    {
+        std::string path;
+        TextureUsage usage = TextureUsage::Color;
+        bool compress = false;
+        bool s3tcSupported = false;
+        // streaming needs every level on the CPU, so uncompressed images get a GL_RGBA8 chain in image as well
+        bool mipChain = false;
+        unsigned int textureID = 0;
+        // either the decoded image or, if compressed is true, the mip chain
+        unsigned char *data = nullptr;
+        int width = 0, height = 0, nrComponents = 0;
+        bool compressed = false;
+        CompressedImage image;
+    };
+
+    // a mip level the upload thread finished submitting; visible to the render thread once fence signals
+    struct Published
+    {
+        unsigned int textureID;
+        int level, levelCount;
+        GLsync fence;
+    };
+
+    // one slot of the upload thread's pixel buffer ring
+    struct PixelBuffer
+    {
+        unsigned int id = 0;
+        size_t capacity = 0;
+        GLsync fence = 0;
+    };
+    static const int PIXEL_BUFFER_COUNT = 4;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable pendingCondition;
+    std::condition_variable decodedCondition;
+    std::deque<std::unique_ptr<Job>> pending;
+    std::deque<std::unique_ptr<Job>> decoded;
+    unsigned int outstanding = 0;
+    bool stopping = false;
+    std::chrono::steady_clock::time_point batchStart;
+    // texture memory of everything uploaded so far, and what it would have taken as uncompressed RGBA8 with mipmaps
+    size_t uploadedBytes = 0;
+    size_t uncompressedBytes = 0;
+
+    // streaming state; published is filled by the upload thread, visiblePending belongs to the render thread
+    bool streaming = false;
+    bool streamingStopping = false;
+    GLFWwindow *uploadWindow = NULL;
+    std::thread uploadThread;
+    std::deque<Published> published;
+    std::deque<Published> visiblePending;
+    unsigned int streamedTextures = 0;
+    unsigned int frames = 0;
+    unsigned int hitchFrames = 0;
+    float averageFrameTime = 0.0f;
+
+    // runs on the GL thread
+    static bool s3tcSupported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+                if (extension && std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+                    supported = 1;
+            }
+        }
+        return supported == 1;
+    }
+
+    void printBatchStats(unsigned int uploaded)
+    {
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+        std::cout << "TextureLoader: " << uploaded << " textures decoded on " << workers.size()
+                  << " threads and uploaded in " << ms << " ms, " << uploadedBytes / 1024 << " KiB of texture memory ("
+                  << uncompressedBytes / 1024 << " KiB uncompressed)" << std::endl;
+    }
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                pendingCondition.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(pending.front());
+                pending.pop_front();
+            }
+
+            decode(*job);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(std::move(job));
+            }
+            decodedCondition.notify_one();
+        }
+    }
+
+    // runs on a worker thread
+    static void decode(Job &job)
+    {
+        if (job.compress)
+        {
+            for (GLenum format : compressedFormatsFor(job.usage, job.s3tcSupported))
+            {
+                std::string cachePath = compressedCachePath(job.path, format, job.usage);
+                if (compressedCacheIsFresh(job.path, cachePath) && readCompressedImage(cachePath, job.image) && job.image.format == format)
+                {
+                    job.compressed = true;
+                    return;
+                }
+            }
+        }
+
+        // the cone ratios go into the green channel next to the depth, which needs an RGBA image to build them in
+        bool coneStep = job.usage == TextureUsage::ConeStep;
+        job.data = stbi_load(job.path.c_str(), &job.width, &job.height, &job.nrComponents, coneStep ? 4 : 0);
+        if (job.data && coneStep)
+        {
+            ConeStepMap::build(job.data, job.width, job.height);
+            job.nrComponents = 4;
+        }
+        if (job.data && job.compress &&
+            compressImage(job.data, job.width, job.height, job.nrComponents, job.usage, job.s3tcSupported, job.image))
+        {
+            if (!writeCompressedImage(compressedCachePath(job.path, job.image.format, job.usage), job.image))
+                std::cout << "WARNING::TEXTURE:: failed to write compressed cache for " << job.path << std::endl;
+        }
+        else if (job.data && (job.mipChain || coneStep))
+        {
+            // glGenerateMipmap would average the cones, which makes them too wide
+            buildRGBAMipChain(job.data, job.width, job.height, job.nrComponents, job.usage, job.image);
+        }
+        else
+        {
+            return;
+        }
+        stbi_image_free(job.data);
+        job.data = nullptr;
+        job.compressed = true;
+    }
+
+    // the uncompressed counterpart of compressImage() for streaming: a GL_RGBA8 mip chain
+    static void buildRGBAMipChain(const unsigned char *data, int width, int height, int nrComponents, TextureUsage usage, CompressedImage &image)
+    {
+        std::vector<unsigned char> level = expandToRGBA(data, width, height, nrComponents);
+        image.format = GL_RGBA8;
+        image.levels.clear();
+        image.data.clear();
+        while (true)
+        {
+            CompressedImage::Level info = {width, height, image.data.size(), level.size()};
+            image.levels.push_back(info);
+            image.data.insert(image.data.end(), level.begin(), level.end());
+            if (width == 1 && height == 1)
+                break;
+            level = downsampleRGBA(level, width, height, usage);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    }
+
+    // runs on the GL thread
+    void upload(Job &job)
+    {
+        if (job.compressed)
+        {
+            glBindTexture(GL_TEXTURE_2D, job.textureID);
+            for (size_t level = 0; level < job.image.levels.size(); level++)
+            {
+                const CompressedImage::Level &info = job.image.levels[level];
+                if (job.image.format == GL_RGBA8)
+                    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &job.image.data[info.offset]);
+                else
+                    glCompressedTexImage2D(GL_TEXTURE_2D, level, job.image.format, info.width, info.height, 0, info.size,
+                                           &job.image.data[info.offset]);
+                uncompressedBytes += info.width * info.height * 4;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job.image.levels.size() - 1);
+            uploadedBytes += job.image.data.size();
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            job.image = CompressedImage();
+        }
+        else if (job.data)
+        {
+            GLenum format = GL_RGB;
+            if (job.nrComponents == 1)
+                format = GL_RED;
+            else if (job.nrComponents == 3)
+                format = GL_RGB;
+            else if (job.nrComponents == 4)
+                format = GL_RGBA;
+
+            glBindTexture(GL_TEXTURE_2D, job.textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, job.data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            // drivers pad RGB to four bytes per texel; the mip chain adds another third
+            uploadedBytes += (size_t)job.width * job.height * (job.nrComponents == 1 ? 1 : 4) * 4 / 3;
+            uncompressedBytes += (size_t)job.width * job.height * 4 * 4 / 3;
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            stbi_image_free(job.data);
+            job.data = nullptr;
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        }
+    }
+
+    // the upload thread: owns uploadWindow's context and the pixel buffer ring
+    void uploadLoop()
+    {
+        glfwMakeContextCurrent(uploadWindow);
+        PixelBuffer ring[PIXEL_BUFFER_COUNT];
+        for (PixelBuffer &buffer : ring)
+            glGenBuffers(1, &buffer.id);
+        unsigned int nextBuffer = 0;
+
+        while (true)
+        {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                decodedCondition.wait(lock, [this] { return streamingStopping || !decoded.empty(); });
+                if (streamingStopping)
+                    break;
+                job = std::move(decoded.front());
+                decoded.pop_front();
+            }
+
+            if (!job->compressed && job->data)
+            {
+                // queued before streaming started
+                buildRGBAMipChain(job->data, job->width, job->height, job->nrComponents, job->usage, job->image);
+                stbi_image_free(job->data);
+                job->data = nullptr;
+                job->compressed = true;
+            }
+
+            if (job->compressed)
+            {
+                // coarsest level first, so the texture becomes usable (if blurry) after a single small upload
+                int levelCount = job->image.levels.size();
+                for (int level = levelCount - 1; level >= 0; level--)
+                {
+                    PixelBuffer &buffer = ring[nextBuffer++ % PIXEL_BUFFER_COUNT];
+                    streamLevel(*job, level, buffer);
+                    Published item = {job->textureID, level, levelCount, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+                    glFlush();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    published.push_back(item);
+                }
+            }
+            else
+            {
+                std::cout << "Texture failed to load at path: " << job->path << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job->compressed)
+            {
+                uploadedBytes += job->image.data.size();
+                for (const CompressedImage::Level &info : job->image.levels)
+                    uncompressedBytes += info.width * info.height * 4;
+                streamedTextures++;
+            }
+            if (--outstanding == 0)
+            {
+                printBatchStats(streamedTextures);
+                streamedTextures = 0;
+            }
+        }
+
+        for (PixelBuffer &buffer : ring)
+        {
+            if (buffer.fence)
+                glDeleteSync(buffer.fence);
+            glDeleteBuffers(1, &buffer.id);
+        }
+        glfwMakeContextCurrent(NULL);
+    }
+
+    // copies one level into a pixel buffer and sources the texture level from it (upload thread)
+    static void streamLevel(const Job &job, int level, PixelBuffer &buffer)
+    {
+        const CompressedImage::Level &info = job.image.levels[level];
+        // the GPU may still be reading the last upload from this slot
+        if (buffer.fence)
+        {
+            while (glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                ;
+            glDeleteSync(buffer.fence);
+            buffer.fence = 0;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+        if (info.size > buffer.capacity)
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, info.size, NULL, GL_STREAM_DRAW);
+            buffer.capacity = info.size;
+        }
+        void *target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, info.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (target)
+        {
+            memcpy(target, &job.image.data[info.offset], info.size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, job.textureID);
+        if (job.image.format == GL_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, job.image.format, info.width, info.height, 0, info.size, (void *)0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+};
+
+#endif
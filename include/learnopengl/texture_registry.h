@@ -0,0 +1,168 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/texture_loader.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide table of every texture loaded from a file, shared by loadTexture() in main.cpp and Model.
+// A request is first looked up by canonical path and then by the file contents, so the same image reached through
+// different paths (or copied next to another model) is uploaded once. Only files of the same size can have the same
+// contents, so a file is hashed only when a resident texture's file has its size, and that file's hash is computed
+// then too; every other path miss costs a stat() on the GL thread and leaves reading the file to the TextureLoader's
+// workers. Texture names are reference counted: every acquire() has to be matched by a release(), and the last
+// release deletes the texture.
+class TextureRegistry
+{
+public:
+    static TextureRegistry &instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // returns a texture for the file, queuing it on the TextureLoader if it isn't resident yet. Must be called on the GL thread.
+    unsigned int acquire(const std::string &path, TextureUsage usage = TextureUsage::Color)
+    {
+        requests++;
+        std::string canonical = canonicalPath(path);
+        std::string pathKey = canonical + '#' + std::to_string((int)usage);
+        auto byPath = pathToTexture.find(pathKey);
+        if (byPath != pathToTexture.end())
+        {
+            avoidedByPath++;
+            return addReference(byPath->second);
+        }
+
+        std::string sizeKey = fileSize(canonical) + '#' + std::to_string((int)usage);
+        std::string contentKey;
+        auto sameSize = sizeToTextures.find(sizeKey);
+        if (sameSize != sizeToTextures.end())
+        {
+            contentKey = contentHash(canonical);
+            for (unsigned int candidate : sameSize->second)
+            {
+                Entry &other = entries[candidate];
+                if (other.contentKey.empty())
+                    other.contentKey = contentHash(other.source);
+                if (other.contentKey != contentKey)
+                    continue;
+                avoidedByContent++;
+                pathToTexture[pathKey] = candidate;
+                other.pathKeys.push_back(pathKey);
+                return addReference(candidate);
+            }
+        }
+
+        unsigned int textureID = TextureLoader::instance().load(path, usage);
+        Entry &entry = entries[textureID];
+        entry.references = 1;
+        entry.source = canonical;
+        entry.sizeKey = sizeKey;
+        entry.contentKey = contentKey;
+        entry.pathKeys.push_back(pathKey);
+        pathToTexture[pathKey] = textureID;
+        sizeToTextures[sizeKey].push_back(textureID);
+        return textureID;
+    }
+
+    // drops one reference; the texture is deleted together with its last reference
+    void release(unsigned int textureID)
+    {
+        auto entry = entries.find(textureID);
+        if (entry == entries.end() || --entry->second.references > 0)
+            return;
+        for (const std::string &pathKey : entry->second.pathKeys)
+            pathToTexture.erase(pathKey);
+        std::vector<unsigned int> &sameSize = sizeToTextures[entry->second.sizeKey];
+        sameSize.erase(std::remove(sameSize.begin(), sameSize.end(), textureID), sameSize.end());
+        if (sameSize.empty())
+            sizeToTextures.erase(entry->second.sizeKey);
+        entries.erase(entry);
+        glDeleteTextures(1, &textureID);
+    }
+
+    void printStats() const
+    {
+        std::cout << "TextureRegistry: " << requests << " requests, " << entries.size() << " resident textures, "
+                  << avoidedByPath + avoidedByContent << " uploads avoided (" << avoidedByPath << " same path, "
+                  << avoidedByContent << " same content)" << std::endl;
+    }
+
+private:
+    struct Entry
+    {
+        unsigned int references = 0;
+        // the canonical path the texture was loaded from, hashed once another file of its size comes along
+        std::string source;
+        std::string sizeKey;
+        // empty until hashed
+        std::string contentKey;
+        std::vector<std::string> pathKeys;
+    };
+
+    std::unordered_map<std::string, unsigned int> pathToTexture;
+    std::unordered_map<std::string, std::vector<unsigned int>> sizeToTextures;
+    std::unordered_map<unsigned int, Entry> entries;
+    unsigned int requests = 0;
+    unsigned int avoidedByPath = 0;
+    unsigned int avoidedByContent = 0;
+
+    unsigned int addReference(unsigned int textureID)
+    {
+        entries[textureID].references++;
+        return textureID;
+    }
+
+    static std::string canonicalPath(const std::string &path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return path;
+    }
+
+    // files that can't be read are keyed by path so they never alias each other
+    static std::string fileSize(const std::string &path)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0)
+            return "missing:" + path;
+        return std::to_string((long long)status.st_size);
+    }
+
+    // 64 bit FNV-1a of the file plus its size; files that can't be read hash by path so they never alias each other
+    static std::string contentHash(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return "missing:" + path;
+        uint64_t hash = 14695981039346656037ull;
+        uint64_t size = 0;
+        char buffer[1 << 16];
+        while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+        {
+            std::streamsize count = in.gcount();
+            for (std::streamsize i = 0; i < count; i++)
+            {
+                hash ^= (unsigned char)buffer[i];
+                hash *= 1099511628211ull;
+            }
+            size += count;
+        }
+        return std::to_string(hash) + ':' + std::to_string(size);
+    }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef UNIFORM_ID_H
+#define UNIFORM_ID_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 32 bit FNV-1a of a uniform name, usable in constant expressions
+constexpr uint32_t uniformHash(const char *name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr size_t uniformNameLength(const char *name)
+{
+    size_t length = 0;
+    while (name[length] != '\0')
+        length++;
+    return length;
+}
+
+// Identifies a uniform by the hash of its name. Written as "dirLight.direction"_uniform the hash is computed by the
+// compiler, so Shader's setters only do a table lookup: no string, no hashing and no glGetUniformLocation per call.
+struct UniformID
+{
+    uint32_t hash;
+
+    constexpr explicit UniformID(uint32_t hash) : hash(hash)
+    {
+    }
+
+    // for names only known at run time, e.g. "material.texture_diffuse" + number
+    constexpr explicit UniformID(const char *name) : hash(uniformHash(name, uniformNameLength(name)))
+    {
+    }
+};
+
+// the characters of a name literal as a type, so its hash is a static constant the compiler has to evaluate; a
+// constexpr function in argument position, as in setMat4("view"_uniform, ...), may otherwise run at run time
+template <typename Char, Char... name>
+struct UniformName
+{
+    static_assert(sizeof(Char) == 1, "uniform names are narrow string literals");
+    static constexpr char characters[] = {name..., '\0'};
+    static constexpr uint32_t hash = uniformHash(characters, sizeof...(name));
+};
+
+template <typename Char, Char... name>
+constexpr char UniformName<Char, name...>::characters[];
+
+// a string literal operator template, a GNU extension GCC and Clang both support
+template <typename Char, Char... name>
+constexpr UniformID operator"" _uniform()
+{
+    return UniformID(UniformName<Char, name...>::hash);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#version 330 core
+// one direction of ScreenBlur's separable Gaussian, at the mip level the blur runs at. Past the center texel the
+// kernel is stored as pairs of neighbouring texels, each read with a single bilinear fetch at the offset between
+// them that weighs the two like the kernel does.
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+const int MAX_TAPS = 9;
+
+uniform sampler2D image;
+uniform float lod;
+// one texel of the level along the blur direction
+uniform vec2 direction;
+uniform int taps;
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+
+void main()
+{
+    vec3 color = textureLod(image, TexCoords, lod).rgb * weights[0];
+    for (int i = 1; i < taps; i++)
+    {
+        color += textureLod(image, TexCoords + direction * offsets[i], lod).rgb * weights[i];
+        color += textureLod(image, TexCoords - direction * offsets[i], lod).rgb * weights[i];
+    }
+    FragColor = vec4(color, 1.0);
+}
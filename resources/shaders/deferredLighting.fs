@@ -0,0 +1,126 @@
+#version 330 core
+// the full screen lighting pass of the deferred path: the directional light and the spotlight, which reach every
+// pixel; the point lights are added by deferredPointLight.fs
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
+    bool spotLightOn;
+    int pointLightCount;
+    vec2 tileScale;
+    float sliceScale;
+    float sliceBias;
+    int tilesX;
+    int tilesY;
+    int slices;
+    bool clustered;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 cascadeMatrices[3];
+    bool dirShadows;
+};
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec3 viewPosition;
+uniform float shininess;
+uniform mat4 view;
+
+// the directional light's shadow cascades, see CascadedShadows
+uniform sampler2DArrayShadow dirShadowMap;
+
+// the fraction of the directional light reaching fragPos; the lookup is pushed out along the surface normal by
+// about a texel of the cascade, more where the light grazes the surface, to keep the surface from shadowing itself
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    if (!dirShadows)
+        return 1.0;
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if (depth >= cascadeSplits.z)
+        return 1.0;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : 2);
+    float grazing = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    vec3 offset = normal * cascadeTexelSizes[cascade] * (0.5 + 1.5 * grazing);
+    vec3 shadowCoord = (cascadeMatrices[cascade] * vec4(fragPos + offset, 1.0)).xyz;
+    // the linear filter of the comparison sampler gives 2x2 percentage closer filtering
+    return texture(dirShadowMap, vec4(shadowCoord.xy, float(cascade), shadowCoord.z));
+}
+
+vec3 OctahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // fold the lower half back from the corners
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+float CalcBlinnPhongSpecular(vec3 lightDir, vec3 viewDir, vec3 normal)
+{
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    return pow(max(dot(normal, halfwayDir), 0.0), shininess * 2);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing was drawn here, leave the clear color
+    if (depth == 1.0)
+        discard;
+    vec4 clip = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 albedo = albedoSpecular.rgb;
+    float specularIntensity = albedoSpecular.a;
+    vec3 normal = OctahedralDecode(texelFetch(gNormal, pixel, 0).xy);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcBlinnPhongSpecular(lightDir, viewDir, normal);
+    float shadow = DirShadow(fragPos, normal);
+    vec3 result = dirLight.ambient * albedo + shadow * (dirLight.diffuse * diff * albedo + dirLight.specular * spec * specularIntensity);
+
+    if (spotLightOn) {
+        lightDir = normalize(spotLight.position - fragPos);
+        diff = max(dot(normal, lightDir), 0.0);
+        spec = CalcBlinnPhongSpecular(lightDir, viewDir, normal);
+        float distance = length(spotLight.position - fragPos);
+        float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance + spotLight.quadratic * (distance * distance));
+        float theta = dot(lightDir, normalize(-spotLight.direction));
+        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+        result += (spotLight.ambient * albedo + spotLight.diffuse * diff * albedo + spotLight.specular * spec * specularIntensity)
+                  * attenuation * intensity;
+    }
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,73 @@
+#version 330 core
+// adds one point light to the pixels its volume covers; blended additively over deferredLighting.fs
+out vec4 FragColor;
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+flat in int LightIndex;
+
+// the point lights, four texels each (PointLightData in point_light_buffer.h)
+uniform samplerBuffer pointLights;
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec3 viewPosition;
+uniform float shininess;
+
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(pointLights, 4 * index);
+    vec4 ambientConstant = texelFetch(pointLights, 4 * index + 1);
+    vec4 diffuseLinear = texelFetch(pointLights, 4 * index + 2);
+    vec4 specularQuadratic = texelFetch(pointLights, 4 * index + 3);
+    return PointLight(positionRadius.xyz, positionRadius.w, ambientConstant.rgb, ambientConstant.a,
+                      diffuseLinear.rgb, diffuseLinear.a, specularQuadratic.rgb, specularQuadratic.a);
+}
+
+vec3 OctahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // fold the lower half back from the corners
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+    vec4 clip = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    PointLight light = FetchPointLight(LightIndex);
+    float distance = length(light.position - fragPos);
+    // the volume is a bit larger than the light's sphere
+    if (distance >= light.radius)
+        discard;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 normal = OctahedralDecode(texelFetch(gNormal, pixel, 0).xy);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    vec3 lightDir = (light.position - fragPos) / distance;
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess * 2);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    vec3 result = light.ambient * albedoSpecular.rgb + light.diffuse * diff * albedoSpecular.rgb + light.specular * spec * albedoSpecular.a;
+    FragColor = vec4(result * attenuation, 1.0);
+}
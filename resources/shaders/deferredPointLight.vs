@@ -0,0 +1,16 @@
+#version 330 core
+// one instance per point light: the unit light volume scaled to the light's radius
+layout (location = 0) in vec3 aPos;
+
+flat out int LightIndex;
+
+uniform samplerBuffer pointLights;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec4 positionRadius = texelFetch(pointLights, 4 * gl_InstanceID);
+    LightIndex = gl_InstanceID;
+    gl_Position = projection * view * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+}
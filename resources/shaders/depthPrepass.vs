@@ -0,0 +1,19 @@
+#version 330 core
+// the depth pre-pass: the position goes through exactly the same operations as in shader.vs and
+// normalMappingShader.vs, and gl_Position is invariant in all three, so the shading pass can test with GL_EQUAL
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform bool instanced;
+
+invariant gl_Position;
+
+void main()
+{
+    mat4 world = instanced ? aInstanceModel : model;
+    vec3 fragPos = vec3(world * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -4,46 +4,11 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D screenTexture;
-uniform bool blur;
-
-const float offset = 1.0 / 300.0;
+// 0 for the scene; when blurring, the level of the smaller texture ScreenBlur left its result in, which the linear
+// filter upsamples to the screen
+uniform float lod;
 
 void main()
 {
-    vec2 offsets[9] = vec2[](
-            vec2(-offset,  offset), // top-left
-            vec2( 0.0f,    offset), // top-center
-            vec2( offset,  offset), // top-right
-            vec2(-offset,  0.0f),   // center-left
-            vec2( 0.0f,    0.0f),   // center-center
-            vec2( offset,  0.0f),   // center-right
-            vec2(-offset, -offset), // bottom-left
-            vec2( 0.0f,   -offset), // bottom-center
-            vec2( offset, -offset)  // bottom-right
-        );
-
-       float kernel[9] = float[](
-           1.0 / 16, 2.0 / 16, 1.0 / 16,
-           2.0 / 16, 4.0 / 16, 2.0 / 16,
-           1.0 / 16, 2.0 / 16, 1.0 / 16
-       );
-
-
-     vec3 sampleTex[9];
-     vec3 col;
-     if (blur) {
-        for(int i = 0; i < 9; i++)
-        {
-            sampleTex[i] = vec3(texture(screenTexture, TexCoords.st + offsets[i]));
-        }
-        col = vec3(0.0);
-        for(int i = 0; i < 9; i++)
-            col += sampleTex[i] * kernel[i];
-       }
-       else {
-            col=texture(screenTexture,TexCoords).rgb;
-       }
-
-        FragColor = vec4(col, 1.0);
-
+    FragColor = vec4(textureLod(screenTexture, TexCoords, lod).rgb, 1.0);
 }
@@ -0,0 +1,38 @@
+#version 330 core
+// the geometry pass of the deferred path for the props drawn with shader.vs: writes the surface attributes that
+// deferredLighting.fs and deferredPointLight.fs light, instead of lighting the fragment itself
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec2 gNormal;
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in vec4 Tint;
+
+uniform bool blending;
+uniform Material material;
+
+vec2 OctahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    // fold the lower half over the diagonals
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+void main()
+{
+    vec4 albedo = texture(material.texture_diffuse1, TexCoords);
+    if (blending && albedo.a < 0.1)
+        discard;
+    gAlbedoSpecular = vec4(albedo.rgb * Tint.rgb, texture(material.texture_specular1, TexCoords).r);
+    gNormal = OctahedralEncode(normalize(Normal));
+}
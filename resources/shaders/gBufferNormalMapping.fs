@@ -0,0 +1,172 @@
+#version 330 core
+// the geometry pass of the deferred path for the surfaces drawn with normalMappingShader.vs: parallax and normal
+// mapping as in normalMappingShader.fs, with the world space normal written to the G-buffer instead of being lit
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec2 gNormal;
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+    sampler2D texture_normal1;
+    sampler2D texture_height1;
+
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec2 TexCoords;
+in vec4 Tint;
+in mat3 TangentToWorld;
+in vec3 TangentViewPos;
+in vec3 TangentFragPos;
+
+uniform Material material;
+uniform vec3 viewPos;
+uniform bool parallax;
+uniform float heightScale;
+// the walls' height map is a cone step map; the linear search of ParallaxMapping is kept for comparison
+uniform bool coneStepMapping;
+
+// material LOD (MaterialLod in material_lod.h): the fade ranges of the parallax and normal mapping levels as
+// (start distance, end distance, start texels per pixel, end texels per pixel)
+uniform vec4 parallaxLod;
+uniform vec4 normalLod;
+// -1 when drawing; while MaterialLod counts fragments, only the ones of this level are kept
+uniform int materialLodCount;
+
+// how much of a level is left at this fragment: 1 before the start of either range, 0 past the end of either
+float MaterialLodWeight(vec4 fade, float viewDistance, sampler2D map)
+{
+    vec2 size = vec2(textureSize(map, 0));
+    float footprint = max(length(dFdx(TexCoords) * size), length(dFdy(TexCoords) * size));
+    return 1.0 - max(smoothstep(fade.x, fade.y, viewDistance), smoothstep(fade.z, fade.w, footprint));
+}
+
+vec2 OctahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    // fold the lower half over the diagonals
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+   // number of depth layers
+    const float minLayers = 8;
+    const float maxLayers = 32;
+    float numLayers = mix(maxLayers, minLayers, abs(dot(vec3(0.0, 0.0, 1.0), viewDir)));
+    // calculate the size of each layer
+    float layerDepth = 1.0 / numLayers;
+    // depth of current layer
+    float currentLayerDepth = 0.0;
+    // the amount to shift the texture coordinates per layer (from vector P)
+    vec2 P = viewDir.xy / viewDir.z * heightScale;
+    vec2 deltaTexCoords = P / numLayers;
+
+    // get initial values
+    vec2  currentTexCoords     = texCoords;
+    float currentDepthMapValue = texture(material.texture_height1, currentTexCoords).r;
+
+    while(currentLayerDepth < currentDepthMapValue)
+    {
+        // shift texture coordinates along direction of P
+        currentTexCoords -= deltaTexCoords;
+        // get depthmap value at current texture coordinates
+        currentDepthMapValue = texture(material.texture_height1, currentTexCoords).r;
+        // get depth of next layer
+        currentLayerDepth += layerDepth;
+    }
+
+    // get texture coordinates before collision (reverse operations)
+    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+
+    // get depth after and before collision for linear interpolation
+    float afterDepth  = currentDepthMapValue - currentLayerDepth;
+    float beforeDepth = texture(material.texture_height1, prevTexCoords).r - currentLayerDepth + layerDepth;
+
+    // interpolation of texture coordinates
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+
+    return finalTexCoords;
+}
+
+// relaxed cone step mapping (see cone_step_map.h): the height map holds the depth in red and the square root of
+// each texel's cone ratio in green. Each step moves the ray to the boundary of the cone it is in, which never
+// crosses the surface more than once, so the ray is either still above the surface or has just gone below it;
+// a short binary search over the last step finds the intersection.
+const int CONE_STEPS = 12;
+const int BINARY_STEPS = 4;
+
+vec2 ConeStepMapping(vec2 texCoords, vec3 viewDir)
+{
+    // the ray through the depth volume per unit of depth, and its texture space distance per unit of depth
+    vec3 rayStep = vec3(-viewDir.xy / viewDir.z * heightScale, 1.0);
+    float rayRatio = length(rayStep.xy);
+    vec3 position = vec3(texCoords, 0.0);
+    vec3 lastStep = vec3(0.0);
+    // stop within a step of the 8 bit depth map
+    float height = 1.0;
+    for (int i = 0; i < CONE_STEPS && height >= 1.0 / 255.0; i++)
+    {
+        vec2 depthCone = texture(material.texture_height1, position.xy).rg;
+        height = depthCone.r - position.z;
+        if (height >= 1.0 / 255.0)
+        {
+            // a zero ratio would stop the ray where the map is flat at the bottom
+            float coneRatio = max(depthCone.g * depthCone.g, 1.0 / 1024.0);
+            lastStep = rayStep * (coneRatio * height / (rayRatio + coneRatio));
+            position += lastStep;
+        }
+    }
+
+    if (height < 0.0)
+    {
+        vec3 range = 0.5 * lastStep;
+        position -= range;
+        for (int i = 0; i < BINARY_STEPS; i++)
+        {
+            range *= 0.5;
+            if (position.z < texture(material.texture_height1, position.xy).r)
+                position += range;
+            else
+                position -= range;
+        }
+    }
+    return position.xy;
+}
+
+void main()
+{
+    float viewDistance = distance(viewPos, FragPos);
+    float parallaxWeight = parallax ? MaterialLodWeight(parallaxLod, viewDistance, material.texture_height1) : 0.0;
+    float normalWeight = max(MaterialLodWeight(normalLod, viewDistance, material.texture_normal1), parallaxWeight);
+    if (materialLodCount >= 0) {
+        int level = parallaxWeight > 0.0 ? 0 : (normalWeight > 0.0 ? 1 : 2);
+        if (level != materialLodCount)
+            discard;
+        gAlbedoSpecular = vec4(0.0);
+        gNormal = vec2(0.0);
+        return;
+    }
+
+    vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
+    vec2 texCoords = TexCoords;
+    if (parallaxWeight > 0.0) {
+        texCoords = coneStepMapping ? ConeStepMapping(TexCoords, viewDir) : ParallaxMapping(TexCoords, viewDir);
+        texCoords = mix(TexCoords, texCoords, parallaxWeight);
+    }
+
+    vec3 normal = normalize(TangentToWorld[2]);
+    if (normalWeight > 0.0) {
+        // only x/y of the normal map are stored (BC5), z is reconstructed
+        vec2 normalXY = texture(material.texture_normal1, texCoords).rg * 2.0 - 1.0;
+        vec3 mapped = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+        normal = normalize(mix(normal, normalize(TangentToWorld * mapped), normalWeight));
+    }
+
+    gAlbedoSpecular = vec4(texture(material.texture_diffuse1, texCoords).rgb * Tint.rgb, texture(material.texture_specular1, texCoords).r);
+    gNormal = OctahedralEncode(normal);
+}
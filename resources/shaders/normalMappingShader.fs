@@ -3,13 +3,12 @@ out vec4 FragColor;
 
 struct PointLight {
     vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
+    float radius;
     vec3 ambient;
-
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
 };
 
@@ -23,19 +22,84 @@ struct DirLight {
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
 
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// shared by every lit program through LightUniformBuffer; the members are ordered so each vec3 packs with a float
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
+    bool spotLightOn;
+    int pointLightCount;
+    vec2 tileScale;
+    float sliceScale;
+    float sliceBias;
+    int tilesX;
+    int tilesY;
+    int slices;
+    bool clustered;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 cascadeMatrices[3];
+    bool dirShadows;
 };
 
+// the point lights, four texels each (PointLightData in point_light_buffer.h)
+uniform samplerBuffer pointLights;
+
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(pointLights, 4 * index);
+    vec4 ambientConstant = texelFetch(pointLights, 4 * index + 1);
+    vec4 diffuseLinear = texelFetch(pointLights, 4 * index + 2);
+    vec4 specularQuadratic = texelFetch(pointLights, 4 * index + 3);
+    return PointLight(positionRadius.xyz, positionRadius.w, ambientConstant.rgb, ambientConstant.a,
+                      diffuseLinear.rgb, diffuseLinear.a, specularQuadratic.rgb, specularQuadratic.a);
+}
+
+// the clustered light lists of LightClusters: (first entry, count) per cluster and the light indices
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLights;
+uniform mat4 view;
+
+// the range of clusterLights holding the lights that may reach this fragment
+uvec2 ClusterLightRange(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * tileScale), ivec2(tilesX - 1, tilesY - 1));
+    int slice = clamp(int(log(depth) * sliceScale + sliceBias), 0, slices - 1);
+    return texelFetch(clusterGrid, (slice * tilesY + tile.y) * tilesX + tile.x).rg;
+}
+
+// the directional light's shadow cascades, see CascadedShadows
+uniform sampler2DArrayShadow dirShadowMap;
+
+// the fraction of the directional light reaching fragPos; the lookup is pushed out along the surface normal by
+// about a texel of the cascade, more where the light grazes the surface, to keep the surface from shadowing itself
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    if (!dirShadows)
+        return 1.0;
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if (depth >= cascadeSplits.z)
+        return 1.0;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : 2);
+    float grazing = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    vec3 offset = normal * cascadeTexelSizes[cascade] * (0.5 + 1.5 * grazing);
+    vec3 shadowCoord = (cascadeMatrices[cascade] * vec4(fragPos + offset, 1.0)).xyz;
+    // the linear filter of the comparison sampler gives 2x2 percentage closer filtering
+    return texture(dirShadowMap, vec4(shadowCoord.xy, float(cascade), shadowCoord.z));
+}
+
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
@@ -47,17 +111,32 @@ struct Material {
 
 in vec3 FragPos;
 in vec2 TexCoords;
-in vec3 TangentLightPos;
+in vec4 Tint;
+in mat3 TangentToWorld;
 in vec3 TangentViewPos;
 in vec3 TangentFragPos;
 
-uniform bool spotLightOn;
-uniform PointLight pointLight;
-uniform DirLight dirLight;
-uniform SpotLight spotLight;
 uniform Material material;
+uniform vec3 viewPos;
 uniform bool parallax;
 uniform float heightScale;
+// the walls' height map is a cone step map; the linear search of ParallaxMapping is kept for comparison
+uniform bool coneStepMapping;
+
+// material LOD (MaterialLod in material_lod.h): the fade ranges of the parallax and normal mapping levels as
+// (start distance, end distance, start texels per pixel, end texels per pixel)
+uniform vec4 parallaxLod;
+uniform vec4 normalLod;
+// -1 when drawing; while MaterialLod counts fragments, only the ones of this level are kept
+uniform int materialLodCount;
+
+// how much of a level is left at this fragment: 1 before the start of either range, 0 past the end of either
+float MaterialLodWeight(vec4 fade, float viewDistance, sampler2D map)
+{
+    vec2 size = vec2(textureSize(map, 0));
+    float footprint = max(length(dFdx(TexCoords) * size), length(dFdy(TexCoords) * size));
+    return 1.0 - max(smoothstep(fade.x, fade.y, viewDistance), smoothstep(fade.z, fade.w, footprint));
+}
 
 float CalcBlinnPhongSpecular(vec3 lightDir, vec3 viewDir,vec3 normal){
     vec3 halfwayDir = normalize(lightDir + viewDir);
@@ -67,13 +146,13 @@ float CalcBlinnPhongSpecular(vec3 lightDir, vec3 viewDir,vec3 normal){
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(TangentLightPos - TangentFragPos);
+    vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     float spec = CalcBlinnPhongSpecular(lightDir,viewDir,normal);
     // attenuation
-    float distance = length(TangentLightPos - TangentFragPos);
+    float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
@@ -85,7 +164,8 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// shadow scales the diffuse and specular terms, see DirShadow
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -96,7 +176,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
@@ -165,24 +245,94 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
     return finalTexCoords;
 }
 
+// relaxed cone step mapping (see cone_step_map.h): the height map holds the depth in red and the square root of
+// each texel's cone ratio in green. Each step moves the ray to the boundary of the cone it is in, which never
+// crosses the surface more than once, so the ray is either still above the surface or has just gone below it;
+// a short binary search over the last step finds the intersection.
+const int CONE_STEPS = 12;
+const int BINARY_STEPS = 4;
+
+vec2 ConeStepMapping(vec2 texCoords, vec3 viewDir)
+{
+    // the ray through the depth volume per unit of depth, and its texture space distance per unit of depth
+    vec3 rayStep = vec3(-viewDir.xy / viewDir.z * heightScale, 1.0);
+    float rayRatio = length(rayStep.xy);
+    vec3 position = vec3(texCoords, 0.0);
+    vec3 lastStep = vec3(0.0);
+    // stop within a step of the 8 bit depth map
+    float height = 1.0;
+    for (int i = 0; i < CONE_STEPS && height >= 1.0 / 255.0; i++)
+    {
+        vec2 depthCone = texture(material.texture_height1, position.xy).rg;
+        height = depthCone.r - position.z;
+        if (height >= 1.0 / 255.0)
+        {
+            // a zero ratio would stop the ray where the map is flat at the bottom
+            float coneRatio = max(depthCone.g * depthCone.g, 1.0 / 1024.0);
+            lastStep = rayStep * (coneRatio * height / (rayRatio + coneRatio));
+            position += lastStep;
+        }
+    }
+
+    if (height < 0.0)
+    {
+        vec3 range = 0.5 * lastStep;
+        position -= range;
+        for (int i = 0; i < BINARY_STEPS; i++)
+        {
+            range *= 0.5;
+            if (position.z < texture(material.texture_height1, position.xy).r)
+                position += range;
+            else
+                position -= range;
+        }
+    }
+    return position.xy;
+}
+
 void main()
 {
-    // offset texture coordinates with Parallax Mapping
+    // both weights are worked out in uniform control flow, where the derivatives are defined
+    float viewDistance = distance(viewPos, FragPos);
+    float parallaxWeight = parallax ? MaterialLodWeight(parallaxLod, viewDistance, material.texture_height1) : 0.0;
+    // parallax without the normal map would look flat, so normal mapping lasts at least as long
+    float normalWeight = max(MaterialLodWeight(normalLod, viewDistance, material.texture_normal1), parallaxWeight);
+    if (materialLodCount >= 0) {
+        int level = parallaxWeight > 0.0 ? 0 : (normalWeight > 0.0 ? 1 : 2);
+        if (level != materialLodCount)
+            discard;
+        FragColor = vec4(0.0);
+        return;
+    }
+
+    // offset texture coordinates with Parallax Mapping, less of it as the level fades out
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
     vec2 texCoords = TexCoords;
 
-    if(parallax){
-         texCoords = ParallaxMapping(TexCoords,  viewDir);
+    if(parallaxWeight > 0.0){
+         texCoords = coneStepMapping ? ConeStepMapping(TexCoords, viewDir) : ParallaxMapping(TexCoords,  viewDir);
+         texCoords = mix(TexCoords, texCoords, parallaxWeight);
     }
 
- // obtain normal from normal map in range [0,1]
-    vec3 normal = texture(material.texture_normal1, texCoords).rgb;
-    // transform normal vector to range [-1,1]
-    normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
+    vec3 normal = normalize(TangentToWorld[2]);
+    if (normalWeight > 0.0) {
+        // obtain normal from normal map in range [0,1]; only x/y are stored (BC5), z is reconstructed
+        vec2 normalXY = texture(material.texture_normal1, texCoords).rg * 2.0 - 1.0;
+        // transform normal vector to range [-1,1]
+        vec3 mapped = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));  // this normal is in tangent space
+        // the lights are in world space, any number of them, so the normal goes to world space rather than each light to tangent space
+        normal = normalize(mix(normal, normalize(TangentToWorld * mapped), normalWeight));
+    }
+    viewDir = normalize(viewPos - FragPos);
 
-    vec3 result = CalcDirLight(dirLight, normal, viewDir);
-    result += CalcPointLight(pointLight, normal, FragPos, viewDir);
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, DirShadow(FragPos, normalize(TangentToWorld[2])));
+    uvec2 range = clustered ? ClusterLightRange(FragPos) : uvec2(0u, uint(pointLightCount));
+    for (uint i = 0u; i < range.y; i++) {
+        PointLight light = FetchPointLight(clustered ? int(texelFetch(clusterLights, int(range.x + i)).r) : int(i));
+        if (distance(light.position, FragPos) < light.radius)
+            result += CalcPointLight(light, normal, FragPos, viewDir);
+    }
     if (spotLightOn)
         result += CalcSpotLight(spotLight, normal, FragPos, viewDir);
-    FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+    FragColor = vec4(result * Tint.rgb, 1.0);
+}
@@ -1,36 +1,68 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// with compactVertices (CompactVertex in mesh.h) aPos is the quantized position with the bitangent sign in w, and
+// aNormal/aTangent hold octahedral encodings in xy; the bitangent isn't stored
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+// per instance attributes, read instead of the model uniform when instanced is set
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in vec4 aInstanceTint;
 
 out vec3 FragPos;
 out vec2 TexCoords;
-out vec3 TangentLightPos;
+out vec4 Tint;
+out mat3 TangentToWorld;
 out vec3 TangentViewPos;
 out vec3 TangentFragPos;
 
-uniform vec3 lightPos;
 uniform vec3 viewPos;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
+uniform bool compactVertices;
+// matches the depth pre-pass (depthPrepass.vs) exactly
+invariant gl_Position;
+
+vec3 OctahedralDecode(vec2 e)
+{
+       vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+       // fold the lower half back from the corners
+       float t = max(-n.z, 0.0);
+       n.x += n.x >= 0.0 ? -t : t;
+       n.y += n.y >= 0.0 ? -t : t;
+       return normalize(n);
+}
 
 void main()
 {
-       FragPos = vec3(model * vec4(aPos, 1.0));
+       // the dequantization of compact positions is part of the model matrix (Model::VertexTransform)
+       vec3 position = aPos.xyz;
+       vec3 normal = aNormal;
+       vec3 tangent = aTangent;
+       vec3 bitangent = aBitangent;
+       if (compactVertices) {
+              normal = OctahedralDecode(aNormal.xy);
+              tangent = OctahedralDecode(aTangent.xy);
+              bitangent = cross(normal, tangent) * aPos.w;
+       }
+
+       mat4 world = instanced ? aInstanceModel : model;
+       FragPos = vec3(world * vec4(position, 1.0));
        TexCoords = aTexCoords;
+       Tint = instanced ? aInstanceTint : vec4(1.0);
 
-       vec3 T = normalize(mat3(model) * aTangent);
-       vec3 B = normalize(mat3(model) * aBitangent);
-       vec3 N = normalize(mat3(model) * aNormal);
-       mat3 TBN = transpose(mat3(T, B, N));
+       vec3 T = normalize(mat3(world) * tangent);
+       vec3 B = normalize(mat3(world) * bitangent);
+       vec3 N = normalize(mat3(world) * normal);
+       TangentToWorld = mat3(T, B, N);
+       mat3 TBN = transpose(TangentToWorld);
 
-       TangentLightPos = TBN * lightPos;
        TangentViewPos  = TBN * viewPos;
        TangentFragPos  = TBN * FragPos;
 
-       gl_Position = projection * view * model * vec4(aPos, 1.0);
+       gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
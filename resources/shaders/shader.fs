@@ -3,13 +3,12 @@ out vec4 FragColor;
 
 struct PointLight {
     vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
+    float radius;
     vec3 ambient;
-
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
 };
 
@@ -23,19 +22,84 @@ struct DirLight {
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
 
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// shared by every lit program through LightUniformBuffer; the members are ordered so each vec3 packs with a float
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
+    bool spotLightOn;
+    int pointLightCount;
+    vec2 tileScale;
+    float sliceScale;
+    float sliceBias;
+    int tilesX;
+    int tilesY;
+    int slices;
+    bool clustered;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 cascadeMatrices[3];
+    bool dirShadows;
 };
 
+// the point lights, four texels each (PointLightData in point_light_buffer.h)
+uniform samplerBuffer pointLights;
+
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(pointLights, 4 * index);
+    vec4 ambientConstant = texelFetch(pointLights, 4 * index + 1);
+    vec4 diffuseLinear = texelFetch(pointLights, 4 * index + 2);
+    vec4 specularQuadratic = texelFetch(pointLights, 4 * index + 3);
+    return PointLight(positionRadius.xyz, positionRadius.w, ambientConstant.rgb, ambientConstant.a,
+                      diffuseLinear.rgb, diffuseLinear.a, specularQuadratic.rgb, specularQuadratic.a);
+}
+
+// the clustered light lists of LightClusters: (first entry, count) per cluster and the light indices
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLights;
+uniform mat4 view;
+
+// the range of clusterLights holding the lights that may reach this fragment
+uvec2 ClusterLightRange(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * tileScale), ivec2(tilesX - 1, tilesY - 1));
+    int slice = clamp(int(log(depth) * sliceScale + sliceBias), 0, slices - 1);
+    return texelFetch(clusterGrid, (slice * tilesY + tile.y) * tilesX + tile.x).rg;
+}
+
+// the directional light's shadow cascades, see CascadedShadows
+uniform sampler2DArrayShadow dirShadowMap;
+
+// the fraction of the directional light reaching fragPos; the lookup is pushed out along the surface normal by
+// about a texel of the cascade, more where the light grazes the surface, to keep the surface from shadowing itself
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    if (!dirShadows)
+        return 1.0;
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if (depth >= cascadeSplits.z)
+        return 1.0;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : 2);
+    float grazing = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    vec3 offset = normal * cascadeTexelSizes[cascade] * (0.5 + 1.5 * grazing);
+    vec3 shadowCoord = (cascadeMatrices[cascade] * vec4(fragPos + offset, 1.0)).xyz;
+    // the linear filter of the comparison sampler gives 2x2 percentage closer filtering
+    return texture(dirShadowMap, vec4(shadowCoord.xy, float(cascade), shadowCoord.z));
+}
+
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
@@ -46,12 +110,9 @@ struct Material {
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec4 Tint;
 
-uniform bool spotLightOn;
 uniform bool blending;
-uniform PointLight pointLight;
-uniform DirLight dirLight;
-uniform SpotLight spotLight;
 uniform Material material;
 uniform vec3 viewPosition;
 
@@ -81,7 +142,8 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// shadow scales the diffuse and specular terms, see DirShadow
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -92,7 +154,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
@@ -124,10 +186,16 @@ void main()
 {
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcDirLight(dirLight, normal, viewDir);
-    result += CalcPointLight(pointLight, normal, FragPos, viewDir);
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, DirShadow(FragPos, normal));
+    uvec2 range = clustered ? ClusterLightRange(FragPos) : uvec2(0u, uint(pointLightCount));
+    for (uint i = 0u; i < range.y; i++) {
+        PointLight light = FetchPointLight(clustered ? int(texelFetch(clusterLights, int(range.x + i)).r) : int(i));
+        if (distance(light.position, FragPos) < light.radius)
+            result += CalcPointLight(light, normal, FragPos, viewDir);
+    }
     if (spotLightOn)
         result += CalcSpotLight(spotLight, normal, FragPos, viewDir);
+    result *= Tint.rgb;
     if(blending) {
          vec4 texColor = vec4(result,texture(material.texture_diffuse1, TexCoords).a);
             if(texColor.a < 0.1)
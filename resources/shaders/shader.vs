@@ -2,19 +2,28 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance attributes, read instead of the model uniform when instanced is set
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in vec4 aInstanceTint;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec4 Tint;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
+// matches the depth pre-pass (depthPrepass.vs) exactly
+invariant gl_Position;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal =  mat3(transpose(inverse(model))) * aNormal;
+    mat4 world = instanced ? aInstanceModel : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal =  mat3(transpose(inverse(world))) * aNormal;
     TexCoords = aTexCoords;
+    Tint = instanced ? aInstanceTint : vec4(1.0);
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
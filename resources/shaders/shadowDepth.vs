@@ -0,0 +1,14 @@
+#version 330 core
+// the depth of the shadow casters in one of the directional light's cascades
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
+
+uniform mat4 model;
+uniform mat4 lightSpace;
+uniform bool instanced;
+
+void main()
+{
+    mat4 world = instanced ? aInstanceModel : model;
+    gl_Position = lightSpace * world * vec4(aPos, 1.0);
+}
@@ -10,7 +10,30 @@
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/light_uniform_buffer.h>
+#include <learnopengl/point_light_buffer.h>
+#include <learnopengl/deferred_renderer.h>
+#include <learnopengl/screen_blur.h>
+#include <learnopengl/render_target.h>
+#include <learnopengl/dynamic_resolution.h>
+#include <learnopengl/light_clusters.h>
+#include <learnopengl/cascaded_shadows.h>
+#include <learnopengl/static_geometry.h>
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/scene_bvh.h>
+#include <learnopengl/lod_selector.h>
+#include <learnopengl/material_lod.h>
+#include <learnopengl/benchmark.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/cone_step_map.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -18,12 +41,20 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
-unsigned int loadTexture(const char *path);
+unsigned int loadTexture(const char *path, TextureUsage usage = TextureUsage::Color);
+void benchmarkUniformSetters(Shader &shader);
+vector<Instance> barrelGrid(unsigned int count, const glm::mat4 &single);
+void benchmarkCulling(unsigned int objectCount);
+void benchmarkParallax(const std::string &heightMapPath);
+vector<PointLightData> pointLightGrid(unsigned int count, const PointLightData &roomLight);
 
 
 // settings
 const unsigned int SCR_WIDTH = 1100;
 const unsigned int SCR_HEIGHT = 850;
+// the framebuffer size of the window, which the scene is rendered at times the render scale
+unsigned int windowWidth = SCR_WIDTH;
+unsigned int windowHeight = SCR_HEIGHT;
 float heightScale = 0.1;
 
 // camera
@@ -39,6 +70,9 @@ float lastFrame = 0.0f;
 bool blur = false;
 bool spotLightOn = false;
 bool redLight = false;
+bool deferredShading = false;
+bool coneStepMapping = false;
+bool depthPrepass = false;
 
 struct PointLight {
     glm::vec3 position;
@@ -76,9 +110,115 @@ struct SpotLight {
 
 PointLight pointLight;
 
-int main() {
+// a prop (or room surface) placed once per instance: every instance is an object of the scene BVH, and each frame
+// the draws are submitted with only the visible instances, grouped by the level of detail they are drawn at
+struct PropGroup {
+    struct Draw {
+        unsigned int pass;
+        Shader *shader;
+        unsigned int material;
+        unsigned int VAO;
+        vector<MeshLod> lods;
+        unsigned int indexType = GL_UNSIGNED_INT;
+    };
+    vector<Draw> draws;
+    Bounds bounds; // object space
+    vector<Instance> instances;
+    unsigned int lodLevels = 1;
+    vector<Instance> visible[LodSelector::MAX_LEVELS];
+    // how the prop goes into the directional light's shadow cascades; static casters are cached
+    enum ShadowCasting { NoShadow, StaticShadow, DynamicShadow };
+    ShadowCasting shadow = NoShadow;
+};
+
+int main(int argc, char **argv) {
+    // --gpu-csv <file>: write the per-pass GPU times to a CSV file on exit
+    // --benchmark [frames]: render a scripted camera path offscreen without vsync, print timings and exit
+    // --barrels <count>: fill the room with a grid of instanced barrels instead of the single one
+    std::string gpuProfileCSV;
+    unsigned int benchmarkFrames = 0;
+    unsigned int barrelCount = 1;
+    // --compact-vertices: upload the barrel model as 20 byte CompactVertex instead of 56 byte Vertex
+    VertexFormat barrelFormat = VertexFormat::Full;
+    // --point-lights <count>: add dimmer point lights under the ceiling, up to count in total
+    // --deferred: start with the deferred path (G toggles it)
+    unsigned int pointLightCount = 1;
+    // --depth-prepass: start with the depth pre-pass on (P toggles it)
+    // --no-clusters: forward shading loops over every point light instead of its cluster's
+    bool clusteredLighting = true;
+    // --uncached-shadows: re-render the static shadow casters every frame
+    bool shadowCaching = true;
+    // --cone-step-parallax: start with cone step mapping instead of the linear search of ParallaxMapping (C toggles it)
+    // --height-scale <scale>: depth of the parallax walls' relief, in texture space (Q/E change it)
+    // --parallax-lod / --normal-lod <d0,d1,f0,f1>: where the parallax and normal mapping levels of the material LOD fade
+    // out, by distance (d0 to d1) and texels per pixel (f0 to f1); --no-material-lod keeps every level everywhere
+    MaterialLod materialLod;
+    // --blur-radius <pixels>: radius of the LSHIFT blur; --blur keeps it on, e.g. for --benchmark
+    float blurRadius = 8.0f;
+    bool blurAlways = false;
+    // --render-scale <scale>: render the scene at this fraction of the window's resolution (0.25 to 1) and upscale it
+    // --dynamic-resolution [ms]: adjust the render scale every frame to keep the GPU time within the budget
+    DynamicResolution dynamicResolution;
+    for (int i = 1; i < argc; i++) {
+        std::string argument(argv[i]);
+        if (argument == "--gpu-csv" && i + 1 < argc)
+            gpuProfileCSV = argv[++i];
+        else if (argument == "--benchmark")
+            benchmarkFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? std::stoi(argv[++i]) : 1000;
+        else if (argument == "--barrels" && i + 1 < argc)
+            barrelCount = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--compact-vertices")
+            barrelFormat = VertexFormat::Compact;
+        else if (argument == "--point-lights" && i + 1 < argc)
+            pointLightCount = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--deferred")
+            deferredShading = true;
+        else if (argument == "--no-clusters")
+            clusteredLighting = false;
+        else if (argument == "--depth-prepass")
+            depthPrepass = true;
+        else if (argument == "--uncached-shadows")
+            shadowCaching = false;
+        else if (argument == "--cone-step-parallax")
+            coneStepMapping = true;
+        else if (argument == "--height-scale" && i + 1 < argc)
+            heightScale = std::min(1.0f, std::max(0.0f, (float)std::atof(argv[++i])));
+        else if ((argument == "--parallax-lod" || argument == "--normal-lod") && i + 1 < argc) {
+            MaterialLod::Fade &fade = argument == "--parallax-lod" ? materialLod.parallax : materialLod.normalMapping;
+            if (sscanf(argv[++i], "%f,%f,%f,%f", &fade.startDistance, &fade.endDistance, &fade.startFootprint, &fade.endFootprint) != 4)
+                std::cout << "ERROR::ARGUMENTS:: " << argument << " expects four comma separated numbers" << std::endl;
+        }
+        else if (argument == "--no-material-lod")
+            materialLod.disable();
+        else if (argument == "--blur-radius" && i + 1 < argc)
+            blurRadius = (float)std::atof(argv[++i]);
+        else if (argument == "--blur")
+            blurAlways = true;
+        else if (argument == "--render-scale" && i + 1 < argc)
+            dynamicResolution = DynamicResolution(dynamicResolution.targetMilliseconds,
+                                                  std::min(1.0f, std::max(0.25f, (float)std::atof(argv[++i]))));
+        else if (argument == "--dynamic-resolution")
+            dynamicResolution.targetMilliseconds =
+                (i + 1 < argc && isdigit(argv[i + 1][0])) ? std::max(1.0f, (float)std::atof(argv[++i])) : 16.7f;
+    }
+    bool benchmarkMode = benchmarkFrames > 0;
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-culling") {
+        benchmarkCulling(argc > 2 ? std::max(1, std::atoi(argv[2])) : 100000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-parallax") {
+        benchmarkParallax(FileSystem::getPath("resources/textures/BRICKS_DISP.jpg"));
+        return 0;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+    // the benchmark doesn't need a window system: GLFW's null platform renders through OSMesa (llvmpipe)
+    if (benchmarkMode)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -88,6 +228,13 @@ int main() {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    if (benchmarkMode) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+    }
+
     // glfw window creation
     // --------------------
     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
@@ -97,7 +244,16 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (benchmarkMode)
+        glfwSwapInterval(0);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    {
+        // larger than the window size on high DPI displays
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        windowWidth = width;
+        windowHeight = height;
+    }
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
@@ -112,6 +268,11 @@ int main() {
         return -1;
     }
 
+    // upload textures from a background context so loading never stalls the render loop; the benchmark
+    // uploads everything before its first frame instead
+    if (!benchmarkMode)
+        TextureLoader::instance().startStreaming(window);
+
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
@@ -125,7 +286,40 @@ int main() {
     Shader normalMappingShader("resources/shaders/normalMappingShader.vs", "resources/shaders/normalMappingShader.fs");
     Shader screenShader("resources/shaders/framebufferScreenShader.vs", "resources/shaders/framebufferScreenShader.fs");
 
-    Model ourModel(FileSystem::getPath("resources/objects/rust_gas/Gasoline_barrel.obj"));
+    // the deferred path's G-buffer programs, with the same vertex shaders
+    Shader gBufferShader("resources/shaders/shader.vs", "resources/shaders/gBuffer.fs");
+    Shader gBufferNormalMappingShader("resources/shaders/normalMappingShader.vs", "resources/shaders/gBufferNormalMapping.fs");
+    // the render targets start at the window's size and follow the render size from the first frame on
+    DeferredRenderer deferredRenderer(windowWidth, windowHeight);
+    ScreenBlur screenBlur(windowWidth, windowHeight, blurRadius);
+
+    LightUniformBuffer lightUniformBuffer;
+    lightUniformBuffer.attach(shader);
+    lightUniformBuffer.attach(normalMappingShader);
+    lightUniformBuffer.attach(deferredRenderer.lighting);
+    PointLightBuffer pointLightBuffer;
+    pointLightBuffer.attach(shader);
+    pointLightBuffer.attach(normalMappingShader);
+    pointLightBuffer.attach(deferredRenderer.pointLighting);
+    LightClusters lightClusters;
+    lightClusters.attach(shader);
+    lightClusters.attach(normalMappingShader);
+    Shader shadowShader("resources/shaders/shadowDepth.vs", "resources/shaders/shadowDepth.fs");
+    Shader depthPrepassShader("resources/shaders/depthPrepass.vs", "resources/shaders/shadowDepth.fs");
+    CascadedShadows cascadedShadows;
+    cascadedShadows.caching = shadowCaching;
+    cascadedShadows.attach(shader);
+    cascadedShadows.attach(normalMappingShader);
+    cascadedShadows.attach(deferredRenderer.lighting);
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-uniforms") {
+        benchmarkUniformSetters(shader);
+        TextureLoader::instance().stopStreaming();
+        glfwTerminate();
+        return 0;
+    }
+
+    Model ourModel(FileSystem::getPath("resources/objects/rust_gas/Gasoline_barrel.obj"), false, barrelFormat);
     ourModel.SetShaderTextureNamePrefix("material.");
 
     pointLight.position = glm::vec3(0.0f, 3.5, 0.0);
@@ -137,6 +331,17 @@ int main() {
     pointLight.linear = 0.09f;
     pointLight.quadratic = 0.032f;
 
+    PointLightData roomLight;
+    roomLight.position = pointLight.position;
+    roomLight.ambient = pointLight.ambient;
+    roomLight.diffuse = pointLight.diffuse;
+    roomLight.specular = pointLight.specular;
+    roomLight.constant = pointLight.constant;
+    roomLight.linear = pointLight.linear;
+    roomLight.quadratic = pointLight.quadratic;
+    roomLight.radius = PointLightData::rangeOf(roomLight);
+    vector<PointLightData> sceneLights = pointLightGrid(pointLightCount, roomLight);
+
     DirLight dirLight;
     dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
     dirLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
@@ -229,36 +434,34 @@ int main() {
     };
 
 
-    // cube VAO
-    unsigned int cubeVAO, cubeVBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    //normalQuad VAO
-    unsigned int quadVAO, quadVBO;
-    glGenVertexArrays(1, &quadVAO);
-    glGenBuffers(1, &quadVBO);
-    glBindVertexArray(quadVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void *) (6 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void *) (8 * sizeof(float)));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void *) (11 * sizeof(float)));
+    // static geometry: every surface gets its tangent frame once and lives in one indexed buffer
+    StaticGeometry staticGeometry;
+    vector<Vertex> wallQuad = StaticGeometry::quad(glm::vec3(-5.0f, 5.0f, 5.0f), glm::vec3(-5.0f, -0.5f, 5.0f),
+                                                   glm::vec3(-5.0f, -0.5f, -5.0f), glm::vec3(-5.0f, 5.0f, -5.0f),
+                                                   glm::vec2(0.0f, 5.5f), glm::vec2(0.0f, 0.0f),
+                                                   glm::vec2(10.0f, 0.0f), glm::vec2(10.0f, 5.5f),
+                                                   glm::vec3(1.0f, 0.0f, 0.0f));
+    vector<Vertex> floorQuad = StaticGeometry::quad(glm::vec3(-5.0f, -0.5f, -5.0f), glm::vec3(-5.0f, -0.5f, 5.0f),
+                                                    glm::vec3(5.0f, -0.5f, 5.0f), glm::vec3(5.0f, -0.5f, -5.0f),
+                                                    glm::vec2(0.0f, 10.0f), glm::vec2(0.0f, 0.0f),
+                                                    glm::vec2(10.0f, 0.0f), glm::vec2(10.0f, 10.0f),
+                                                    glm::vec3(0.0f, 1.0f, 0.0f));
+    // left, right, front and back wall
+    vector<glm::mat4> wallTransforms;
+    for (float angle : {0.0f, 180.0f, 90.0f, 270.0f})
+        wallTransforms.push_back(glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)));
+    // the floor keeps the quarter turn it was drawn with after the back wall, so its texture doesn't rotate
+    glm::mat4 floorTransform = wallTransforms.back();
+    glm::mat4 ceilingTransform = glm::mat4(1.0f);
+    ceilingTransform = glm::translate(ceilingTransform, glm::vec3(0.0f, 4.5f, 0.0f));
+    ceilingTransform = glm::rotate(ceilingTransform, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+    StaticGeometry::Surface wallsSurface = staticGeometry.add(wallQuad, wallTransforms);
+    StaticGeometry::Surface floorSurface = staticGeometry.add(floorQuad, floorTransform);
+    StaticGeometry::Surface ceilingSurface = staticGeometry.add(floorQuad, ceilingTransform);
+    StaticGeometry::Surface cubeSurface = staticGeometry.add(StaticGeometry::fromInterleaved(cubeVertices, 36));
+    StaticGeometry::Surface decalSurface = staticGeometry.add(StaticGeometry::fromInterleaved(transparentVertices, 6));
+    staticGeometry.build();
 
     // screen quad VAO
     unsigned int screenQuadVAO, screenQuadVBO;
@@ -272,442 +475,501 @@ int main() {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) (2 * sizeof(float)));
 
-    // transparent VAO
-    unsigned int transparentVAO, transparentVBO;
-    glGenVertexArrays(1, &transparentVAO);
-    glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
     glBindVertexArray(0);
 
     // load textures
     // -------------
     unsigned int cubeTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/rust_diffuse.jpg").c_str());
-    unsigned int cubeTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/rust_specular.jpg").c_str());
+    unsigned int cubeTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/rust_specular.jpg").c_str(), TextureUsage::Specular);
     unsigned int ceilingTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/ceiling_diffuse.jpg").c_str());
-    unsigned int ceilingTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/ceiling_specular.jpg").c_str());
-    unsigned int ceilingTextureNormal = loadTexture(FileSystem::getPath("resources/textures/ceiling_normal.jpg").c_str());
+    unsigned int ceilingTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/ceiling_specular.jpg").c_str(), TextureUsage::Specular);
+    unsigned int ceilingTextureNormal = loadTexture(FileSystem::getPath("resources/textures/ceiling_normal.jpg").c_str(), TextureUsage::Normal);
     unsigned int floorTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/concrete_wall.jpg").c_str());
-    unsigned int floorTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/concrete_wall_specular.jpg").c_str());
-    unsigned int floorTextureNormal = loadTexture(FileSystem::getPath("resources/textures/concrete_wall_normal.jpg").c_str());
+    unsigned int floorTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/concrete_wall_specular.jpg").c_str(), TextureUsage::Specular);
+    unsigned int floorTextureNormal = loadTexture(FileSystem::getPath("resources/textures/concrete_wall_normal.jpg").c_str(), TextureUsage::Normal);
     unsigned int cautionTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/caution_diffuse.png").c_str());
-    unsigned int cautionTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/caution_specular.png").c_str());
+    unsigned int cautionTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/caution_specular.png").c_str(), TextureUsage::Specular);
     unsigned int manholeTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/manhole2.png").c_str());
-    unsigned int manholeTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/manhole_specular.png").c_str());
+    unsigned int manholeTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/manhole_specular.png").c_str(), TextureUsage::Specular);
     unsigned int wallTextureDiffuse = loadTexture(FileSystem::getPath("resources/textures/BRICKS.jpg").c_str());
-    unsigned int wallTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/BRICKS_SPEC.jpg").c_str());
-    unsigned int wallTextureNormal = loadTexture(FileSystem::getPath("resources/textures/BRICKS_NORM.jpg").c_str());
-    unsigned int wallTextureDisplacement = loadTexture(FileSystem::getPath("resources/textures/BRICKS_DISP.jpg").c_str());
+    unsigned int wallTextureSpecular = loadTexture(FileSystem::getPath("resources/textures/BRICKS_SPEC.jpg").c_str(), TextureUsage::Specular);
+    unsigned int wallTextureNormal = loadTexture(FileSystem::getPath("resources/textures/BRICKS_NORM.jpg").c_str(), TextureUsage::Normal);
+    unsigned int wallTextureDisplacement = loadTexture(FileSystem::getPath("resources/textures/BRICKS_DISP.jpg").c_str(), TextureUsage::ConeStep);
+    // the textures (including the model's) stream in over the first frames, see TextureLoader::update()
+    TextureRegistry::instance().printStats();
+    if (benchmarkMode)
+        TextureLoader::instance().finish();
+    Benchmark benchmark(benchmarkMode ? benchmarkFrames : 1);
+
+    // render queue: passes in drawing order, materials and the transforms of the props
+    // ---------------------------------------------------------------------------------
+    // samplers follow RenderQueue's material convention: diffuse, specular, normal and height map on units 0-3
+    shader.use();
+    shader.setInt("material.texture_diffuse1"_uniform, 0);
+    shader.setInt("material.texture_specular1"_uniform, 1);
+    normalMappingShader.use();
+    normalMappingShader.setInt("material.texture_diffuse1"_uniform, 0);
+    normalMappingShader.setInt("material.texture_specular1"_uniform, 1);
+    normalMappingShader.setInt("material.texture_normal1"_uniform, 2);
+    normalMappingShader.setInt("material.texture_height1"_uniform, 3);
+    gBufferShader.use();
+    gBufferShader.setInt("material.texture_diffuse1"_uniform, 0);
+    gBufferShader.setInt("material.texture_specular1"_uniform, 1);
+    gBufferNormalMappingShader.use();
+    gBufferNormalMappingShader.setInt("material.texture_diffuse1"_uniform, 0);
+    gBufferNormalMappingShader.setInt("material.texture_specular1"_uniform, 1);
+    gBufferNormalMappingShader.setInt("material.texture_normal1"_uniform, 2);
+    gBufferNormalMappingShader.setInt("material.texture_height1"_uniform, 3);
+
+    // after the depth pre-pass the opaque passes find the depth of the visible surfaces already in place: they only
+    // shade fragments at exactly that depth and leave it as it is. The decals aren't in the pre-pass, their
+    // transparent texels would hide what is behind them, so they test and write depth as usual.
+    auto shadingDepthTest = [](bool opaque) {
+        glDepthFunc(depthPrepass && opaque ? GL_EQUAL : GL_LESS);
+        glDepthMask(depthPrepass && opaque ? GL_FALSE : GL_TRUE);
+    };
+    RenderQueue renderQueue;
+    unsigned int cratePass = renderQueue.addPass("crates", [shadingDepthTest](Shader &program) {
+        glEnable(GL_CULL_FACE);
+        glFrontFace(GL_CW);
+        shadingDepthTest(true);
+        program.setBool("blending"_uniform, false);
+    });
+    unsigned int decalPass = renderQueue.addPass("decals", [shadingDepthTest](Shader &program) {
+        glDisable(GL_CULL_FACE);
+        shadingDepthTest(false);
+        program.setBool("blending"_uniform, true);
+    });
+    unsigned int parallaxPass = renderQueue.addPass("parallax walls", [shadingDepthTest](Shader &program) {
+        glDisable(GL_CULL_FACE);
+        shadingDepthTest(true);
+        program.setBool("parallax"_uniform, true);
+        program.setBool("compactVertices"_uniform, false);
+    });
+    unsigned int normalMappedPass = renderQueue.addPass("floor/ceiling", [shadingDepthTest](Shader &program) {
+        glDisable(GL_CULL_FACE);
+        shadingDepthTest(true);
+        program.setBool("parallax"_uniform, false);
+        program.setBool("compactVertices"_uniform, false);
+    });
+    unsigned int modelPass = renderQueue.addPass("barrel", [&ourModel, shadingDepthTest](Shader &program) {
+        glEnable(GL_CULL_FACE);
+        shadingDepthTest(true);
+        glFrontFace(GL_CCW);
+        program.setBool("parallax"_uniform, false);
+        program.setBool("compactVertices"_uniform, ourModel.format == VertexFormat::Compact);
+    });
+
+    unsigned int crateMaterial = renderQueue.addMaterial({cubeTextureDiffuse, cubeTextureSpecular});
+    unsigned int cautionMaterial = renderQueue.addMaterial({cautionTextureDiffuse, cautionTextureSpecular});
+    unsigned int manholeMaterial = renderQueue.addMaterial({manholeTextureDiffuse, manholeTextureSpecular});
+    unsigned int wallMaterial = renderQueue.addMaterial({wallTextureDiffuse, wallTextureSpecular, wallTextureNormal, wallTextureDisplacement});
+    unsigned int floorMaterial = renderQueue.addMaterial({floorTextureDiffuse, floorTextureSpecular, floorTextureNormal});
+    unsigned int ceilingMaterial = renderQueue.addMaterial({ceilingTextureDiffuse, ceilingTextureSpecular, ceilingTextureNormal});
+    vector<unsigned int> barrelMaterials;
+    for (const Mesh &mesh : ourModel.meshes) {
+        vector<unsigned int> textures;
+        for (const Texture &texture : mesh.textures)
+            textures.push_back(texture.id);
+        barrelMaterials.push_back(renderQueue.addMaterial(textures));
+    }
+
+    // repeated props are drawn instanced, one draw per surface however many copies there are
+    vector<Instance> crateInstances;
+    for (float x : {-2.0f, 2.0f}) {
+        Instance crate;
+        crate.Transform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.155f, -1.5f)), glm::vec3(1.3f));
+        crateInstances.push_back(crate);
+    }
+    vector<Instance> cautionInstances;
+    for (float x : {1.54f, -2.44f}) {
+        Instance caution;
+        caution.Transform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.15f, -0.83f)), glm::vec3(0.9f));
+        cautionInstances.push_back(caution);
+    }
+    glm::mat4 manholeTransform = glm::mat4(1.0f);
+    manholeTransform = glm::translate(manholeTransform, glm::vec3(-4.0f,-0.49f,3.8));
+    manholeTransform = glm::rotate(manholeTransform, glm::radians(90.0f), glm::normalize(glm::vec3(1.0,0.0,0.0)));
+    manholeTransform = glm::scale(manholeTransform, glm::vec3(1.4, 1.4, 1.4));
+    glm::mat4 barrelTransform = glm::mat4(1.0f);
+    barrelTransform = glm::translate(barrelTransform,glm::vec3(0.0f, 0.85f, -3.0f)); // translate it down so it's at the center of the scene
+    barrelTransform = glm::rotate(barrelTransform, glm::radians(172.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
+    barrelTransform = glm::scale(barrelTransform,glm::vec3(0.235f, 0.25f, 0.2f));    // it's a bit too big for our scene, so scale it down
+    vector<Instance> barrelInstances = barrelGrid(barrelCount, barrelTransform);
+
+    auto surfaceDraw = [&staticGeometry](unsigned int pass, Shader &program, unsigned int material, const StaticGeometry::Surface &surface) {
+        return PropGroup::Draw{pass, &program, material, staticGeometry.VAO, {MeshLod{surface.firstIndex, surface.indexCount, 0.0f}}};
+    };
+    auto singleInstance = [](const glm::mat4 &transform) {
+        Instance instance;
+        instance.Transform = transform;
+        return vector<Instance>(1, instance);
+    };
+    vector<PropGroup> props(7);
+    props[0].draws = {surfaceDraw(cratePass, shader, crateMaterial, cubeSurface)};
+    props[0].bounds = cubeSurface.bounds;
+    props[0].instances = crateInstances;
+    props[0].shadow = PropGroup::StaticShadow;
+    props[1].draws = {surfaceDraw(decalPass, shader, cautionMaterial, decalSurface)};
+    props[1].bounds = decalSurface.bounds;
+    props[1].instances = cautionInstances;
+    props[2].draws = {surfaceDraw(decalPass, shader, manholeMaterial, decalSurface)};
+    props[2].bounds = decalSurface.bounds;
+    props[2].instances = singleInstance(manholeTransform);
+    // walls, floor and ceiling are baked in world space
+    props[3].draws = {surfaceDraw(parallaxPass, normalMappingShader, wallMaterial, wallsSurface)};
+    props[3].bounds = wallsSurface.bounds;
+    props[3].instances = singleInstance(glm::mat4(1.0f));
+    props[3].shadow = PropGroup::StaticShadow;
+    props[4].draws = {surfaceDraw(normalMappedPass, normalMappingShader, floorMaterial, floorSurface)};
+    props[4].bounds = floorSurface.bounds;
+    props[4].instances = singleInstance(glm::mat4(1.0f));
+    props[4].shadow = PropGroup::StaticShadow;
+    props[5].draws = {surfaceDraw(normalMappedPass, normalMappingShader, ceilingMaterial, ceilingSurface)};
+    props[5].bounds = ceilingSurface.bounds;
+    props[5].instances = singleInstance(glm::mat4(1.0f));
+    props[5].shadow = PropGroup::StaticShadow;
+    for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+    {
+        props[6].draws.push_back(PropGroup::Draw{modelPass, &normalMappingShader, barrelMaterials[i], ourModel.meshes[i].VAO,
+                                                 ourModel.meshes[i].lods, ourModel.meshes[i].indexType});
+        props[6].lodLevels = std::max(props[6].lodLevels, (unsigned int)std::min(ourModel.meshes[i].lods.size(), (size_t)LodSelector::MAX_LEVELS));
+    }
+    props[6].bounds = ourModel.GetBounds();
+    props[6].instances = barrelInstances;
+    props[6].shadow = PropGroup::DynamicShadow;
+
+    // BVH object i is instance objectInstances[i] of prop objectProps[i]
+    vector<Bounds> objectBounds;
+    vector<unsigned int> objectProps, objectInstances;
+    for (unsigned int prop = 0; prop < props.size(); prop++)
+        for (unsigned int i = 0; i < props[prop].instances.size(); i++) {
+            objectBounds.push_back(props[prop].bounds.transformed(props[prop].instances[i].Transform));
+            objectProps.push_back(prop);
+            objectInstances.push_back(i);
+        }
+    SceneBVH sceneBVH;
+    sceneBVH.build(objectBounds);
+    // the bounds above are in object space; the barrels' vertices may be stored quantized
+    for (Instance &barrel : props[6].instances)
+        barrel.Transform = barrel.Transform * ourModel.VertexTransform;
+    vector<unsigned int> visibleObjects;
+    // the level each object was drawn at last, for the selector's hysteresis
+    vector<unsigned int> objectLods(objectBounds.size(), 0);
+    LodSelector lodSelector;
+
+    // shadow queues: the static casters are rendered into the cascades' cache, the dynamic ones over the composited
+    // cache, a pass per cascade so the GPU profiler times the cached and the per frame part separately
+    Bounds casterBounds;
+    bool firstCaster = true;
+    for (unsigned int object = 0; object < objectBounds.size(); object++)
+        if (props[objectProps[object]].shadow != PropGroup::NoShadow) {
+            if (firstCaster)
+                casterBounds = objectBounds[object];
+            else
+                casterBounds.merge(objectBounds[object]);
+            firstCaster = false;
+        }
+    cascadedShadows.setSceneBounds(casterBounds);
+    RenderQueue shadowCacheQueue, shadowQueue;
+    unsigned int staticShadowPasses[CascadedShadows::CASCADES], dynamicShadowPasses[CascadedShadows::CASCADES];
+    for (unsigned int cascade = 0; cascade < CascadedShadows::CASCADES; cascade++) {
+        auto shadowPass = [&cascadedShadows, cascade](bool cache) {
+            return [&cascadedShadows, cascade, cache](Shader &program) {
+                if (cache)
+                    cascadedShadows.bindCache(cascade);
+                else
+                    cascadedShadows.bindShadowMap(cascade);
+                glEnable(GL_DEPTH_TEST);
+                glDisable(GL_CULL_FACE);
+                glEnable(GL_POLYGON_OFFSET_FILL);
+                glPolygonOffset(1.0f, 2.0f);
+                program.setMat4("lightSpace"_uniform, cascadedShadows.lightSpace(cascade));
+            };
+        };
+        staticShadowPasses[cascade] = shadowCacheQueue.addPass("shadow cache " + std::to_string(cascade), shadowPass(true));
+        dynamicShadowPasses[cascade] = shadowQueue.addPass("shadows " + std::to_string(cascade), shadowPass(false));
+    }
+    unsigned int shadowMaterial = shadowCacheQueue.addMaterial({});
+    shadowQueue.addMaterial({});
+    // the depth pre-pass: every opaque prop at the level of detail it is shaded at, front to back, without culling
+    // so a single pass (and profiler section) covers them all
+    RenderQueue prepassQueue;
+    unsigned int prepassPass = prepassQueue.addPass("depth pre-pass", [](Shader &program) {
+        glDisable(GL_CULL_FACE);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    });
+    unsigned int prepassMaterial = prepassQueue.addMaterial({});
+
+    // the parallax walls drawn again once per material LOD level to count its fragments, see MaterialLod
+    RenderQueue materialLodQueue;
+    unsigned int materialLodPasses[MaterialLod::LEVELS];
+    for (unsigned int level = 0; level < MaterialLod::LEVELS; level++)
+        materialLodPasses[level] = materialLodQueue.addPass("material LOD count " + std::to_string(level), [&materialLod, level](Shader &program) {
+            glDisable(GL_CULL_FACE);
+            program.setBool("parallax"_uniform, true);
+            program.setBool("compactVertices"_uniform, false);
+            materialLod.beginCount((MaterialLod::Level)level, program);
+        });
+    unsigned int wallCountMaterial = materialLodQueue.addMaterial({wallTextureDiffuse, wallTextureSpecular, wallTextureNormal, wallTextureDisplacement});
+
+    // casters are drawn at their full detail with all their instances, the light sees more than the camera
+    auto submitShadowCasters = [&props, &shadowShader](RenderQueue &queue, unsigned int pass, PropGroup::ShadowCasting shadow,
+                                                       unsigned int material) {
+        for (const PropGroup &prop : props)
+            if (prop.shadow == shadow)
+                for (const PropGroup::Draw &draw : prop.draws)
+                    queue.submitInstanced(pass, shadowShader, material, draw.VAO, draw.lods[0].firstIndex, draw.lods[0].indexCount,
+                                          prop.instances, draw.indexType);
+    };
 
     screenShader.use();
-    screenShader.setInt("screenTexture", 0);
+    screenShader.setInt("screenTexture"_uniform, 0);
 
     // framebuffer configuration
     // -------------------------
-    unsigned int framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    // create a color attachment texture
-    unsigned int textureColorbuffer;
-    glGenTextures(1, &textureColorbuffer);
-    glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer, 0);
-    // create a renderbuffer object for depth and stencil attachment (we won't be sampling these)
-    unsigned int rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH,
-                          SCR_HEIGHT); // use a single renderbuffer object for both a depth AND stencil buffer.
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
-                              rbo); // now actually attach it
-    // now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the scene's color texture and depth stencil renderbuffer, reallocated whenever the render size changes
+    RenderTarget sceneTarget(windowWidth, windowHeight);
 
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window)) {
+    while (!glfwWindowShouldClose(window) && !(benchmarkMode && benchmark.finished())) {
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // a minimized window has no pixels to render to
+        if (windowWidth == 0 || windowHeight == 0) {
+            glfwWaitEvents();
+            continue;
+        }
+
         // input
         // -----
-        processInput(window);
+        if (benchmarkMode)
+            benchmark.beginFrame(camera);
+        else
+            processInput(window);
 
+        // make streamed texture levels visible
+        TextureLoader::instance().update(deltaTime);
 
         // render
         // ------
-        // bind to framebuffer and draw scene as we normally would to color texture
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glEnable(GL_DEPTH_TEST); // enable depth testing (is disabled for rendering screen-space quad)
+        GpuProfiler::instance().beginFrame();
+
+        // the scene renders at the window's size times the render scale, which the GPU time of the last completed
+        // frame may have just changed; the render targets follow both that and the window's size
+        dynamicResolution.update(GpuProfiler::instance().completedFrameMilliseconds());
+        unsigned int renderWidth = std::max(1u, (unsigned int)(windowWidth * dynamicResolution.scale() + 0.5f));
+        unsigned int renderHeight = std::max(1u, (unsigned int)(windowHeight * dynamicResolution.scale() + 0.5f));
+        sceneTarget.resize(renderWidth, renderHeight);
+        deferredRenderer.resize(renderWidth, renderHeight);
+        screenBlur.resize(renderWidth, renderHeight);
+        float aspect = (float)windowWidth / (float)windowHeight;
+
+        // the directional light's shadows, static casters only into the cascades that moved
+        cascadedShadows.update(camera.Position, camera.Front, glm::radians(camera.Zoom), aspect, 0.1f, dirLight.direction);
+        shadowCacheQueue.begin(camera.Position);
+        for (unsigned int cascade = 0; cascade < CascadedShadows::CASCADES; cascade++)
+            if (cascadedShadows.isStale(cascade))
+                submitShadowCasters(shadowCacheQueue, staticShadowPasses[cascade], PropGroup::StaticShadow, shadowMaterial);
+        shadowCacheQueue.execute();
+        cascadedShadows.composite();
+        shadowQueue.begin(camera.Position);
+        for (unsigned int cascade = 0; cascade < CascadedShadows::CASCADES; cascade++)
+            submitShadowCasters(shadowQueue, dynamicShadowPasses[cascade], PropGroup::DynamicShadow, shadowMaterial);
+        shadowQueue.execute();
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glViewport(0, 0, renderWidth, renderHeight);
+        cascadedShadows.bind();
+
+        if (deferredShading) {
+            // the props go to the G-buffer and are lit into the framebuffer afterwards
+            deferredRenderer.beginGeometry();
+        } else {
+            // bind to framebuffer and draw scene as we normally would to color texture
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget.framebuffer);
+            glEnable(GL_DEPTH_TEST); // enable depth testing (is disabled for rendering screen-space quad)
 
-        // make sure we clear the framebuffer's content
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // make sure we clear the framebuffer's content
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-        shader.use();
-        shader.setBool("blending", false);
-        shader.setFloat("material.shininess", 32.0f);
-        shader.setVec3("viewPosition", camera.Position);
-        //dirLight
-        shader.setVec3("dirLight.direction", dirLight.direction);
-        shader.setVec3("dirLight.ambient", dirLight.ambient);
-        shader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        shader.setVec3("dirLight.specular", dirLight.specular);
-        //pointLight
+        glm::mat4 view = camera.GetViewMatrix();
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f,100.0f);
+
+        // lights, shared by both lit programs through one uniform buffer
+        LightsBlock lights = {};
+        lights.dirLight.direction = dirLight.direction;
+        lights.dirLight.ambient = dirLight.ambient;
+        lights.dirLight.diffuse = dirLight.diffuse;
+        lights.dirLight.specular = dirLight.specular;
+        // the room's light is the first point light, the flasher when redLight is on
         if (redLight) {
-            shader.setVec3("pointLight.ambient", glm::vec3((int)glfwGetTime()%2*0.3f, 0.0f, 0.0f));
-            shader.setVec3("pointLight.diffuse", glm::vec3((int)glfwGetTime()%2*0.7f, 0.0, 0.0f));
-            shader.setVec3("pointLight.specular", glm::vec3(1.0, 1.0f, 1.0f));
+            sceneLights[0].ambient = glm::vec3((int)glfwGetTime()%2*0.3f, 0.0f, 0.0f);
+            sceneLights[0].diffuse = glm::vec3((int)glfwGetTime()%2*0.7f, 0.0, 0.0f);
+            sceneLights[0].specular = glm::vec3(1.0, 1.0f, 1.0f);
         } else {
-
-            shader.setVec3("pointLight.ambient", pointLight.ambient);
-            shader.setVec3("pointLight.diffuse", pointLight.diffuse);
-            shader.setVec3("pointLight.specular", pointLight.specular);
+            sceneLights[0].ambient = pointLight.ambient;
+            sceneLights[0].diffuse = pointLight.diffuse;
+            sceneLights[0].specular = pointLight.specular;
         }
-        shader.setVec3("pointLight.position", pointLight.position);
-        shader.setFloat("pointLight.constant", pointLight.constant);
-        shader.setFloat("pointLight.linear", pointLight.linear);
-        shader.setFloat("pointLight.quadratic", pointLight.quadratic);
-        //spotLight
-        shader.setBool("spotLightOn", spotLightOn);
-        shader.setVec3("spotLight.position", camera.Position);
-        shader.setVec3("spotLight.direction", camera.Front);
-        shader.setVec3("spotLight.ambient", spotLight.ambient);
-        shader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        shader.setVec3("spotLight.specular", spotLight.specular);
-        shader.setFloat("spotLight.constant", spotLight.constant);
-        shader.setFloat("spotLight.linear", spotLight.linear);
-        shader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        shader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        shader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f,100.0f);
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-
-        // cubes
-        glEnable(GL_CULL_FACE);
-        glFrontFace(GL_CW);
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, cubeTextureSpecular);
-        model = glm::translate(model, glm::vec3(-2.0f, 0.155f, -1.5f));
-        model = glm::scale(model, glm::vec3(1.3, 1.3, 1.3));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.155, -1.5f));
-        model = glm::scale(model, glm::vec3(1.3, 1.3, 1.3));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDisable(GL_CULL_FACE);
-        // blending
-        shader.setBool("blending", true);
-        glBindVertexArray(transparentVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cautionTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, cautionTextureSpecular);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.54f,0.15f,-0.83));
-        model = glm::scale(model, glm::vec3(0.9, 0.9, 0.9));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.44f,0.15f,-0.83));
-        model = glm::scale(model, glm::vec3(0.9, 0.9, 0.9));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, manholeTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, manholeTextureSpecular);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.0f,-0.49f,3.8));
-        model = glm::rotate(model,glm::radians(90.0f), glm::normalize(glm::vec3(1.0,0.0,0.0)));
-        model = glm::scale(model, glm::vec3(1.4, 1.4, 1.4));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        shader.setBool("blending", false);
+        pointLightBuffer.update(sceneLights);
+        pointLightBuffer.bind();
+        lights.pointLightCount = sceneLights.size();
+        // the deferred path lights with light volumes instead
+        if (clusteredLighting && !deferredShading) {
+            lightClusters.build(sceneLights, view, glm::radians(camera.Zoom), aspect, 0.1f, 100.0f, renderWidth, renderHeight);
+            lightClusters.describe(lights);
+            lightClusters.bind();
+            lights.clustered = true;
+        }
+        cascadedShadows.describe(lights);
+        lights.spotLightOn = spotLightOn;
+        lights.spotLight.position = camera.Position;
+        lights.spotLight.direction = camera.Front;
+        lights.spotLight.ambient = spotLight.ambient;
+        lights.spotLight.diffuse = spotLight.diffuse;
+        lights.spotLight.specular = spotLight.specular;
+        lights.spotLight.constant = spotLight.constant;
+        lights.spotLight.linear = spotLight.linear;
+        lights.spotLight.quadratic = spotLight.quadratic;
+        lights.spotLight.cutOff = spotLight.cutOff;
+        lights.spotLight.outerCutOff = spotLight.outerCutOff;
+        lightUniformBuffer.update(lights);
 
+        shader.use();
+        shader.setFloat("material.shininess"_uniform, 32.0f);
+        shader.setVec3("viewPosition"_uniform, camera.Position);
+        shader.setMat4("view"_uniform, view);
+        shader.setMat4("projection"_uniform, projection);
 
         //normalMapping
         normalMappingShader.use();
-        normalMappingShader.setFloat("heightScale", heightScale);
-        normalMappingShader.setVec3("viewPos", camera.Position);
-        normalMappingShader.setVec3("lightPos", pointLight.position);
-        normalMappingShader.setFloat("material.shininess", 32.0f);
-        //dirLight
-        normalMappingShader.setVec3("dirLight.direction", dirLight.direction);
-        normalMappingShader.setVec3("dirLight.ambient", dirLight.ambient);
-        normalMappingShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        normalMappingShader.setVec3("dirLight.specular", dirLight.specular);
-        //pointLight
-        if (redLight) {
-            normalMappingShader.setVec3("pointLight.ambient", glm::vec3((int)glfwGetTime()%2*0.3f, 0.0f, 0.0f));
-            normalMappingShader.setVec3("pointLight.diffuse", glm::vec3((int)glfwGetTime()%2*0.7f, 0.0, 0.0f));
-            normalMappingShader.setVec3("pointLight.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        } else {
-
-            normalMappingShader.setVec3("pointLight.ambient", pointLight.ambient);
-            normalMappingShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-            normalMappingShader.setVec3("pointLight.specular", pointLight.specular);
+        normalMappingShader.setFloat("heightScale"_uniform, heightScale);
+        normalMappingShader.setBool("coneStepMapping"_uniform, coneStepMapping);
+        materialLod.apply(normalMappingShader);
+        normalMappingShader.setVec3("viewPos"_uniform, camera.Position);
+        normalMappingShader.setFloat("material.shininess"_uniform, 32.0f);
+        normalMappingShader.setMat4("projection"_uniform, projection);
+        normalMappingShader.setMat4("view"_uniform, view);
+
+        if (deferredShading) {
+            gBufferShader.use();
+            gBufferShader.setMat4("view"_uniform, view);
+            gBufferShader.setMat4("projection"_uniform, projection);
+            gBufferNormalMappingShader.use();
+            gBufferNormalMappingShader.setFloat("heightScale"_uniform, heightScale);
+            gBufferNormalMappingShader.setBool("coneStepMapping"_uniform, coneStepMapping);
+            materialLod.apply(gBufferNormalMappingShader);
+            gBufferNormalMappingShader.setVec3("viewPos"_uniform, camera.Position);
+            gBufferNormalMappingShader.setMat4("projection"_uniform, projection);
+            gBufferNormalMappingShader.setMat4("view"_uniform, view);
         }
-        normalMappingShader.setVec3("pointLight.position", pointLight.position);
-        normalMappingShader.setFloat("pointLight.constant", pointLight.constant);
-        normalMappingShader.setFloat("pointLight.linear", pointLight.linear);
-        normalMappingShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-        //spotLight
-        normalMappingShader.setBool("spotLightOn", spotLightOn);
-        normalMappingShader.setVec3("spotLight.position", camera.Position);
-        normalMappingShader.setVec3("spotLight.direction", camera.Front);
-        normalMappingShader.setVec3("spotLight.ambient", spotLight.ambient);
-        normalMappingShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        normalMappingShader.setVec3("spotLight.specular", spotLight.specular);
-        normalMappingShader.setFloat("spotLight.constant", spotLight.constant);
-        normalMappingShader.setFloat("spotLight.linear", spotLight.linear);
-        normalMappingShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        normalMappingShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        normalMappingShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        normalMappingShader.setMat4("projection", projection);
-        normalMappingShader.setMat4("view", view);
-        normalMappingShader.setMat4("model", glm::mat4(1.0f));
-
-        normalMappingShader.setBool("parallax", true);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, wallTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, wallTextureSpecular);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, wallTextureNormal);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, wallTextureDisplacement);
-
-
-        glm::vec3 pos1(-5.0f, 5.0f, 5.0f);
-        glm::vec3 pos2(-5.0f, -0.5f, 5.0f);
-        glm::vec3 pos3( -5.0f, -0.5f, -5.0f);
-        glm::vec3 pos4( -5.0f, 5.0f, -5.0f);
-        // texture coordinates
-        glm::vec2 uv1(0.0f, 5.5f);
-        glm::vec2 uv2(0.0f, 0.0f);
-        glm::vec2 uv3(10.0f, 0.0f);
-        glm::vec2 uv4(10.0f, 5.5f);
-        // normal vector
-        glm::vec3 nm(1.0f, 0.0f, 0.0f);
-
-        // calculate tangent/bitangent vectors of both triangles
-        glm::vec3 tangent1, bitangent1;
-        glm::vec3 tangent2, bitangent2;
-        // triangle 1
-        // ----------
-        glm::vec3 edge1 = pos2 - pos1;
-        glm::vec3 edge2 = pos3 - pos1;
-        glm::vec2 deltaUV1 = uv2 - uv1;
-        glm::vec2 deltaUV2 = uv3 - uv1;
-
-        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-        bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-        // triangle 2
-        // ----------
-        edge1 = pos3 - pos1;
-        edge2 = pos4 - pos1;
-        deltaUV1 = uv3 - uv1;
-        deltaUV2 = uv4 - uv1;
-
-        f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-
-        bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-
-        float vertices[] = {
-                // positions            // normal         // texcoords  // tangent                          // bitangent
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
-        };
-
-        //leftWall
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        //rightWall
-        model = glm::mat4(1.0f);
-        model=glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        normalMappingShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        //frontWall
-        model = glm::mat4(1.0f);
-        model=glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        normalMappingShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        //backWall
-        model = glm::mat4(1.0f);
-        model=glm::rotate(model, glm::radians(270.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        normalMappingShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-
-        //floor and ceiling
-        normalMappingShader.setBool("parallax", false);
-
-        pos1 = glm::vec3 (-5.0f, -0.5f, -5.0f);
-        pos2 = glm::vec3 (-5.0f, -0.5f, 5.0f);
-        pos3 = glm::vec3 ( 5.0f, -0.5f, 5.0f);
-        pos4 = glm::vec3 ( 5.0f, -0.5f, -5.0f);
-        // texture coordinates
-        uv1 = glm::vec2 (0.0f, 10.0f);
-        uv2 = glm::vec2 (0.0f, 0.0f);
-        uv3 = glm::vec2 (10.0f, 0.0f);
-        uv4 = glm::vec2(10.0f, 10.f);
-        // normal vector
-        nm = glm::vec3 (0.0f, 1.0f, 0.0f);
-
-        // calculate tangent/bitangent vectors of both triangles
-        // triangle 1
-        // ----------
-        edge1 = pos2 - pos1;
-        edge2 = pos3 - pos1;
-        deltaUV1 = uv2 - uv1;
-        deltaUV2 = uv3 - uv1;
-
-        f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-        bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-        // triangle 2
-        // ----------
-        edge1 = pos3 - pos1;
-        edge2 = pos4 - pos1;
-        deltaUV1 = uv3 - uv1;
-        deltaUV2 = uv4 - uv1;
-
-        f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-
-        bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-
-        float vertices2[] = {
-                // positions            // normal         // texcoords  // tangent                          // bitangent
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
+        // the deferred path draws the same props with the G-buffer variant of their program
+        auto program = [&](Shader *forward) {
+            if (!deferredShading)
+                return forward;
+            return forward == &shader ? &gBufferShader : &gBufferNormalMappingShader;
         };
 
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices2), &vertices2, GL_STATIC_DRAW);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorTextureSpecular);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorTextureNormal);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        //ceiling
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ceilingTextureDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, ceilingTextureSpecular);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, ceilingTextureNormal);
-        model = glm::mat4(1.0f);
-        model=glm::translate(model, glm::vec3(0.0f, 4.5f, 0.0f));
-        model=glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
-        normalMappingShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // frustum culling: only the visible instances of each prop are submitted
+        visibleObjects.clear();
+        sceneBVH.cull(Frustum::fromMatrix(projection * view), visibleObjects);
+        for (PropGroup &prop : props)
+            for (vector<Instance> &level : prop.visible)
+                level.clear();
+        lodSelector.beginFrame();
+        for (unsigned int object : visibleObjects) {
+            PropGroup &prop = props[objectProps[object]];
+            unsigned int level = 0;
+            if (prop.lodLevels > 1) {
+                float size = LodSelector::screenSize(objectBounds[object].Center, objectBounds[object].Radius, camera.Position,
+                                                     glm::radians(camera.Zoom));
+                level = objectLods[object] = lodSelector.select(objectLods[object], size, prop.lodLevels);
+                lodSelector.record(level);
+            }
+            prop.visible[level].push_back(prop.instances[objectInstances[object]]);
+        }
 
+        if (depthPrepass) {
+            depthPrepassShader.use();
+            depthPrepassShader.setMat4("view"_uniform, view);
+            depthPrepassShader.setMat4("projection"_uniform, projection);
+            prepassQueue.begin(camera.Position);
+            for (const PropGroup &prop : props)
+                for (const PropGroup::Draw &draw : prop.draws)
+                    if (draw.pass != decalPass)
+                        for (unsigned int level = 0; level < prop.lodLevels; level++) {
+                            const MeshLod &lod = draw.lods[std::min((size_t)level, draw.lods.size() - 1)];
+                            prepassQueue.submitInstanced(prepassPass, depthPrepassShader, prepassMaterial, draw.VAO, lod.firstIndex,
+                                                         lod.indexCount, prop.visible[level], draw.indexType);
+                        }
+            prepassQueue.execute();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
 
-        //model
-        glEnable(GL_CULL_FACE);
-        glFrontFace(GL_CCW);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(0.0f, 0.85f, -3.0f)); // translate it down so it's at the center of the scene
-        model = glm::rotate(model, glm::radians(172.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model,glm::vec3(0.235f, 0.25f, 0.2f));    // it's a bit too big for our scene, so scale it down
-        normalMappingShader.setMat4("model", model);
-        ourModel.Draw(normalMappingShader);
+        renderQueue.begin(camera.Position);
+        for (const PropGroup &prop : props)
+            for (const PropGroup::Draw &draw : prop.draws)
+                for (unsigned int level = 0; level < prop.lodLevels; level++) {
+                    // meshes with fewer levels than their prop draw their coarsest one
+                    const MeshLod &lod = draw.lods[std::min((size_t)level, draw.lods.size() - 1)];
+                    renderQueue.submitInstanced(draw.pass, *program(draw.shader), draw.material, draw.VAO, lod.firstIndex, lod.indexCount,
+                                                prop.visible[level], draw.indexType);
+                }
+        renderQueue.execute();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        if (materialLod.beginFrame()) {
+            Shader &wallProgram = *program(&normalMappingShader);
+            materialLodQueue.begin(camera.Position);
+            for (unsigned int level = 0; level < MaterialLod::LEVELS; level++)
+                for (const PropGroup::Draw &draw : props[3].draws)
+                    materialLodQueue.submitInstanced(materialLodPasses[level], wallProgram, wallCountMaterial, draw.VAO, draw.lods[0].firstIndex,
+                                                     draw.lods[0].indexCount, props[3].visible[0], draw.indexType);
+            materialLodQueue.execute();
+            materialLod.endCount(wallProgram);
+        }
         glDisable(GL_CULL_FACE);
+        if (deferredShading)
+            deferredRenderer.light(sceneTarget.framebuffer, pointLightBuffer, view, projection, camera.Position, 32.0f);
+
+        // the blurred scene is a smaller texture, upsampled by the screen pass
+        unsigned int screenTexture = sceneTarget.colorTexture;
+        float screenLod = 0.0f;
+        if (blur || blurAlways) {
+            screenTexture = screenBlur.apply(sceneTarget.colorTexture);
+            screenLod = screenBlur.resultLod();
+        }
 
-        // now bind back to default framebuffer and draw a quad plane with the attached framebuffer color texture
+        // now bind back to default framebuffer and draw a quad plane with the attached framebuffer color texture,
+        // upscaled from the render size by its linear filter
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        GpuProfiler::instance().begin("screen");
         glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
         // clear all relevant buffers
         glClearColor(1.0f, 1.0f, 1.0f,1.0f); // set clear color to white (not really necessary actually, since we won't be able to see behind the quad anyways)
         glClear(GL_COLOR_BUFFER_BIT);
 
         screenShader.use();
-        screenShader.setBool("blur", blur);
+        screenShader.setFloat("lod"_uniform, screenLod);
         glBindVertexArray(screenQuadVAO);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D,textureColorbuffer);    // use the color attachment texture as the texture of the quad plane
+        glBindTexture(GL_TEXTURE_2D,screenTexture);    // use the color attachment texture as the texture of the quad plane
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        GpuProfiler::instance().end();
+        GpuProfiler::instance().endFrame();
+        if (benchmarkMode)
+            benchmark.endFrame();
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -718,12 +980,43 @@ int main() {
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &quadVAO);
     glDeleteVertexArrays(1, &screenQuadVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &quadVBO);
     glDeleteBuffers(1, &screenQuadVBO);
+    staticGeometry.release();
+    deferredRenderer.release();
+    screenBlur.release();
+    sceneTarget.release();
+    pointLightBuffer.release();
+    lightClusters.release();
+    cascadedShadows.release();
+    shadowCacheQueue.release();
+    shadowQueue.release();
+    materialLodQueue.release();
+    prepassQueue.release();
+    materialLod.release();
+    sceneBVH.printStats();
+    lodSelector.printStats();
+    materialLod.printStats();
+    lightClusters.printStats();
+    cascadedShadows.printStats();
+    renderQueue.printStats();
+    renderQueue.release();
+    dynamicResolution.printStats();
+    if (benchmarkMode)
+        benchmark.report(windowWidth, windowHeight);
+    else
+        GpuProfiler::instance().report();
+    if (!gpuProfileCSV.empty())
+        GpuProfiler::instance().writeCSV(gpuProfileCSV);
+    GpuProfiler::instance().release();
+    lightUniformBuffer.release();
+    for (unsigned int texture : {cubeTextureDiffuse, cubeTextureSpecular, ceilingTextureDiffuse, ceilingTextureSpecular,
+                                 ceilingTextureNormal, floorTextureDiffuse, floorTextureSpecular, floorTextureNormal,
+                                 cautionTextureDiffuse, cautionTextureSpecular, manholeTextureDiffuse, manholeTextureSpecular,
+                                 wallTextureDiffuse, wallTextureSpecular, wallTextureNormal, wallTextureDisplacement})
+        TextureRegistry::instance().release(texture);
+    ourModel.ReleaseTextures();
+    TextureLoader::instance().stopStreaming();
 
     glfwTerminate();
     return 0;
@@ -768,6 +1061,190 @@ void processInput(GLFWwindow *window)
     }
 }
 
+// times the per-draw matrix uniforms of a shader set by name (string + glGetUniformLocation, the old Shader::set*)
+// against the precomputed "name"_uniform lookups
+// ---------------------------------------------------------------------------------------------
+void benchmarkUniformSetters(Shader &shader) {
+    const char *names[] = {"model", "view", "projection"};
+    const UniformID ids[] = {"model"_uniform, "view"_uniform, "projection"_uniform};
+    const unsigned int count = sizeof(names) / sizeof(names[0]);
+    const unsigned int iterations = 100000;
+    glm::mat4 value(1.0f);
+    shader.use();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < iterations; i++)
+        for (unsigned int j = 0; j < count; j++)
+            glUniformMatrix4fv(glGetUniformLocation(shader.ID, std::string(names[j]).c_str()), 1, GL_FALSE, &value[0][0]);
+    glFinish();
+    auto middle = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < iterations; i++)
+        for (unsigned int j = 0; j < count; j++)
+            shader.setMat4(ids[j], value);
+    glFinish();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double calls = (double)iterations * count;
+    double before = std::chrono::duration<double, std::nano>(middle - start).count() / calls;
+    double after = std::chrono::duration<double, std::nano>(end - middle).count() / calls;
+    std::cout << "Uniform setters: " << before << " ns/call by name, " << after << " ns/call cached ("
+              << before / after << "x)" << std::endl;
+}
+
+// --barrels: count barrels on a square grid across the floor, shrunk to fit their cell once the grid gets dense,
+// each with a slightly different tint. A single barrel keeps its usual place.
+// ---------------------------------------------------------------------------------------------
+vector<Instance> barrelGrid(unsigned int count, const glm::mat4 &single) {
+    vector<Instance> instances(count);
+    if (count == 1) {
+        instances[0].Transform = single;
+        return instances;
+    }
+    unsigned int side = (unsigned int)std::ceil(std::sqrt((float)count));
+    float spacing = 9.0f / side;
+    float shrink = std::min(1.0f, spacing / 1.2f);
+    for (unsigned int i = 0; i < count; i++) {
+        float x = -4.5f + spacing * (i % side + 0.5f);
+        float z = -4.5f + spacing * (i / side + 0.5f);
+        // the barrel's origin sits 1.35 above the floor at full size
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, -0.5f + 1.35f * shrink, z));
+        transform = glm::rotate(transform, glm::radians(172.0f + 37.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
+        instances[i].Transform = glm::scale(transform, glm::vec3(0.235f, 0.25f, 0.2f) * shrink);
+        unsigned int hash = i * 2654435761u;
+        instances[i].Tint = glm::vec4(0.75f + 0.25f * ((hash >> 8) & 0xFF) / 255.0f,
+                                      0.75f + 0.25f * ((hash >> 16) & 0xFF) / 255.0f,
+                                      0.75f + 0.25f * ((hash >> 24) & 0xFF) / 255.0f, 1.0f);
+    }
+    return instances;
+}
+
+// --point-lights: the room's light followed by count - 1 small coloured lights on a grid just under the ceiling,
+// falling off quickly enough that each only lights a few square meters of wall and floor
+// ---------------------------------------------------------------------------------------------
+vector<PointLightData> pointLightGrid(unsigned int count, const PointLightData &roomLight) {
+    vector<PointLightData> lights(1, roomLight);
+    if (count == 1)
+        return lights;
+    unsigned int side = (unsigned int)std::ceil(std::sqrt((float)(count - 1)));
+    float spacing = 9.0f / side;
+    for (unsigned int i = 0; i < count - 1; i++) {
+        PointLightData light;
+        light.position = glm::vec3(-4.5f + spacing * (i % side + 0.5f), 3.9f, -4.5f + spacing * (i / side + 0.5f));
+        unsigned int hash = (i + 1) * 2654435761u;
+        glm::vec3 color(0.3f + 0.7f * ((hash >> 8) & 0xFF) / 255.0f, 0.3f + 0.7f * ((hash >> 16) & 0xFF) / 255.0f,
+                        0.3f + 0.7f * ((hash >> 24) & 0xFF) / 255.0f);
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = 0.8f * color;
+        light.specular = color;
+        light.constant = 1.0f;
+        light.linear = 0.7f;
+        light.quadratic = 1.8f;
+        light.radius = PointLightData::rangeOf(light);
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+// --bench-culling [count]: culls count random boxes spread over a large area with a view from its middle, no GL needed
+// ---------------------------------------------------------------------------------------------
+void benchmarkCulling(unsigned int objectCount) {
+    vector<Bounds> boxes(objectCount);
+    unsigned int seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    for (Bounds &box : boxes) {
+        glm::vec3 center(random() * 200.0f - 100.0f, random() * 20.0f - 10.0f, random() * 200.0f - 100.0f);
+        glm::vec3 extent(0.1f + random() * 2.0f);
+        box.Min = center - extent;
+        box.Max = center + extent;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    SceneBVH bvh;
+    bvh.build(boxes);
+    double buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    vector<unsigned int> visible;
+    for (unsigned int frame = 0; frame < 360; frame++) {
+        glm::vec3 direction(std::cos(glm::radians((float)frame)), -0.1f, std::sin(glm::radians((float)frame)));
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        visible.clear();
+        bvh.cull(Frustum::fromMatrix(projection * view), visible);
+    }
+    std::cout << "Culling: built the BVH over " << objectCount << " boxes in " << buildTime << " ms" << std::endl;
+    bvh.printStats();
+}
+
+// --bench-parallax: builds the cone step map of the walls' height map and traces random view rays through it with
+// CPU models of both parallax searches, counting texture fetches and measuring how far (in texels) each lands from
+// the intersection found by a fine march. The searches sample level 0 of the map BC5 encoded, as the GPU gets it;
+// the march samples the exact depth. No GL needed
+// ---------------------------------------------------------------------------------------------
+void benchmarkParallax(const std::string &heightMapPath) {
+    int width, height, nrComponents;
+    unsigned char *data = stbi_load(heightMapPath.c_str(), &width, &height, &nrComponents, 4);
+    if (!data) {
+        std::cout << "ERROR::PARALLAX:: failed to load " << heightMapPath << std::endl;
+        return;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    ConeStepMap::build(data, width, height);
+    double buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Parallax: built the " << width << "x" << height << " cone step map in " << buildTime << " ms" << std::endl;
+
+    std::vector<float> exact(width * height * 2);
+    for (int i = 0; i < width * height; i++) {
+        exact[2 * i] = data[4 * i] / 255.0f;
+        exact[2 * i + 1] = data[4 * i + 1] / 255.0f;
+    }
+    CompressedImage encoded;
+    compressImage(data, width, height, 4, TextureUsage::ConeStep, false, encoded);
+    std::vector<float> decoded = decodeBC5Level(encoded, 0);
+    ConeStepMap::Sampler exactSample = {exact.data(), width, height};
+    ConeStepMap::Sampler sample = {decoded.data(), width, height};
+    const unsigned int rays = 20000;
+    for (float scale : {0.05f, 0.1f, 0.2f, 0.4f}) {
+        unsigned int seed = 1;
+        auto random = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) / 16777216.0f;
+        };
+        double linearFetches = 0.0, coneFetches = 0.0, linearError = 0.0, coneError = 0.0;
+        unsigned int linearMax = 0, coneMax = 0;
+        for (unsigned int ray = 0; ray < rays; ray++) {
+            glm::vec2 texCoords(random(), random());
+            // views from straight on down to about 78 degrees off the normal
+            float angle = glm::radians(360.0f * random()), cosine = 0.2f + 0.8f * random();
+            float sine = std::sqrt(1.0f - cosine * cosine);
+            glm::vec3 viewDir(std::cos(angle) * sine, std::sin(angle) * sine, cosine);
+
+            glm::vec2 reference = texCoords;
+            glm::vec2 offset = glm::vec2(viewDir) / viewDir.z * scale;
+            for (unsigned int step = 0; step <= 4000; step++) {
+                float depth = step / 4000.0f;
+                if (exactSample(texCoords - offset * depth, 0) <= depth) {
+                    reference = texCoords - offset * depth;
+                    break;
+                }
+            }
+            ConeStepMap::Trace linear = ConeStepMap::traceLinear(sample, texCoords, viewDir, scale);
+            ConeStepMap::Trace cone = ConeStepMap::traceConeStep(sample, texCoords, viewDir, scale);
+            linearFetches += linear.fetches;
+            coneFetches += cone.fetches;
+            linearMax = std::max(linearMax, linear.fetches);
+            coneMax = std::max(coneMax, cone.fetches);
+            linearError += glm::length((linear.texCoords - reference) * glm::vec2(width, height));
+            coneError += glm::length((cone.texCoords - reference) * glm::vec2(width, height));
+        }
+        std::cout << "Parallax: heightScale " << scale << ": linear " << linearFetches / rays << " fetches (max " << linearMax << "), "
+                  << linearError / rays << " texels off; cone step " << coneFetches / rays << " fetches (max " << coneMax << "), "
+                  << coneError / rays << " texels off" << std::endl;
+    }
+    stbi_image_free(data);
+}
+
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
 
     if (key == GLFW_KEY_X && action == GLFW_PRESS) {
@@ -779,6 +1256,21 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         redLight = !redLight;
     }
 
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        deferredShading = !deferredShading;
+        std::cout << (deferredShading ? "Deferred" : "Forward") << " shading" << std::endl;
+    }
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+        std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        coneStepMapping = !coneStepMapping;
+        std::cout << (coneStepMapping ? "Cone step" : "Linear") << " parallax mapping" << std::endl;
+    }
+
 
 }
 
@@ -790,6 +1282,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    // the render targets follow at the start of the next frame
+    windowWidth = width;
+    windowHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -820,39 +1315,10 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 // utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path)
+// textures are shared through the TextureRegistry; a new file is decoded on a TextureLoader worker thread
+// and gets its storage in TextureLoader::finish()
+// ---------------------------------------------------------------------------------------------------------
+unsigned int loadTexture(char const * path, TextureUsage usage)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-    return textureID;
+    return TextureRegistry::instance().acquire(path, usage);
 }